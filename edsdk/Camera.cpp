@@ -1,5 +1,6 @@
 #include "Camera.h"
 #include <windows.h>
+#include <objbase.h>
 
 #include "ErrorMap.h"
 
@@ -8,15 +9,35 @@
 using namespace Filesystem;
 
 #include <cstdio>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
 #include <cassert>
+#include <algorithm>
 using namespace std;
 
 const string Camera::c_cameraName_5D = "Canon EOS 5D Mark II";
 const string Camera::c_cameraName_40D = "Canon EOS 40D";
 const string Camera::c_cameraName_7D = "Canon EOS 7D";
 
+const string Camera::c_partialFileExtension = ".part";
+const long long Camera::c_mappedFileSize = 0x1000000;
+
+const int Camera::c_maxTransferProgress = 1000;
+const int Camera::c_maxPicturePreviews = 16;
+const int Camera::c_maxReportedShots = 100;
+const int Camera::c_ingestListBatch = 32;
+const int Camera::c_ingestListDelay = 2;
+const int Camera::c_takenTimeReadSize = 0x20000;
+const int Camera::c_maxIngestedFiles = 1000;
+const int Camera::c_derivativeQueueDepth = 16;
+const long long Camera::c_bulbSpin = 20000;
+const long long Camera::c_bulbRetry = 100000;
+const int Camera::c_bulbCloseAttempts = 3;
+
 const int Camera::LiveView::c_delay = 200;
-const int Camera::LiveView::c_frameBufferSize = 0x800000;
+const int Camera::LiveView::c_maxConsumers = 3;
+const int Camera::LiveView::c_decodeQueueDepth = 4;
 
 const int Camera::c_sleepTimeout = 10000;
 const int Camera::c_sleepAmount = 50;
@@ -30,6 +51,7 @@ map<EdsUInt32, float> Camera::s_exposureCompensationEnumToFloat;
 
 stringstream * Camera::s_err = NULL;
 queue<Camera::ErrorMessage> Camera::s_errMsgQueue;
+Mutex Camera::s_errMsgMutex;
 Camera::ErrorLevel Camera::s_errorLevel = Camera::None;
 
 void Camera::initialize()
@@ -41,6 +63,7 @@ void Camera::initialize()
     s_err = new stringstream;
 
     initStaticData();
+    ErrorMap::initialize();
     EdsInitializeSDK();
 }
 
@@ -63,6 +86,7 @@ void Camera::initStaticData()
     data40D.zoom500MaxPosition.y = 2080;
     data40D.zoomBoxSize.width = 204;
     data40D.zoomBoxSize.height = 208;
+    data40D.liveViewSurvivesCapture = false;
 
     // 5D
     CameraModelData data5D;
@@ -76,6 +100,7 @@ void Camera::initStaticData()
     data5D.zoom500MaxPosition.y = 2976;
     data5D.zoomBoxSize.width = 202;
     data5D.zoomBoxSize.height = 135;
+    data5D.liveViewSurvivesCapture = true;
 
     // 7D
     CameraModelData data7D;
@@ -89,6 +114,7 @@ void Camera::initStaticData()
     data7D.zoom500MaxPosition.y = 2754;
     data7D.zoomBoxSize.width = 212;
     data7D.zoomBoxSize.height = 144;
+    data7D.liveViewSurvivesCapture = true;
 
     s_modelData[c_cameraName_40D] = data40D;
     s_modelData[c_cameraName_5D] = data5D;
@@ -124,34 +150,124 @@ void Camera::initStaticData()
         s_exposureCompensationEnumToFloat[it->second] = it->first;
 }
 
+Camera::LiveViewStats::LiveViewStats() :
+    framesGrabbed(0),
+    framesSkippedNotReady(0),
+    framesSkippedNotOn(0),
+    framesSkippedExposing(0),
+    transitionTimeouts(0)
+{
+}
+
+Camera::TransferStats::TransferStats() :
+    transfersCompleted(0),
+    transfersFailed(0),
+    bytesTransferred(0)
+{
+}
+
+Camera::TimelapseReport::TimelapseReport() :
+    interval(0),
+    requested(0),
+    startTime(0),
+    taken(0),
+    failed(0),
+    skippedBusy(0),
+    missed(0),
+    overlapped(0)
+{
+}
+
+Camera::IngestReport::IngestReport() :
+    running(false),
+    found(0),
+    bytesFound(0),
+    copied(0),
+    failed(0),
+    alreadyCopied(0),
+    bytesCopied(0),
+    startTime(0),
+    endTime(0),
+    megabytesPerSecond(0)
+{
+}
+
 Camera::LiveView::LiveView() :
     m_state(Off),
-    m_streamPtr(NULL)
+    m_desiredNewState(Off),
+    m_stateEnteredAt(Utils::monotonicMicros()),
+    m_stateAccountedAt(m_stateEnteredAt),
+    m_exposing(false),
+    m_frames(c_maxConsumers),
+    m_sequence(0),
+    m_defaultAcquireTime(0)
 {
-    // set up buffer
-    m_frameBuffer = new unsigned char[c_frameBufferSize];
-    EdsError err = EdsCreateMemoryStreamFromPointer(m_frameBuffer, c_frameBufferSize, &m_streamPtr);
-    
-    if (err) {
-        (*Camera::s_err) << "Unable to create memory stream for live view: " << ErrorMap::errorMsg(err);
-        Camera::pushErrMsg(Camera::Error);
+    // set up a stream for every slot in the mailbox. the SDK grows each one
+    // to fit the biggest frame that has gone into it, which is a few
+    // hundred kilobytes, rather than us guessing at a worst case.
+    for (int i = 0; i < m_frames.slotCount(); i++) {
+        LiveViewFrame & frame = m_frames.slot(i);
+        frame.buffer = NULL;
+        frame.length = 0;
+        frame.info.sequence = 0;
+        frame.info.requestTime = 0;
+        frame.info.downloadTime = 0;
+        frame.info.acquireTime = 0;
+        frame.stream = NULL;
+
+        EdsError err = EdsCreateMemoryStream(0, &frame.stream);
+        if (err) {
+            (*Camera::s_err) << "Unable to create memory stream for live view: " << ErrorMap::errorMsg(err);
+            Camera::pushErrMsg(Camera::Error);
+        }
     }
+
+    m_defaultConsumer = m_frames.addConsumer();
+    m_consumers.push_back(m_defaultConsumer);
 }
 
 Camera::LiveView::~LiveView()
 {
-    EdsRelease(m_streamPtr);
-    delete[] m_frameBuffer;
+    for (int i = 0; i < m_frames.slotCount(); i++) {
+        LiveViewFrame & frame = m_frames.slot(i);
+        if (frame.stream)
+            EdsRelease(frame.stream);
+    }
 }
 
 Camera::Camera() :
     m_liveView(new LiveView()),
+    m_haveCurrentShot(false),
+    m_currentFrame(0),
+    m_frameCount(0),
+    m_lastShutterTime(0),
+    m_focusHeld(false),
+    m_lagShutterTime(0),
+    m_lagPrefocused(false),
+    m_captureLiveViewMode(RestartLiveView),
+    m_decodePool(NULL),
+    m_decodeChannel(-1),
     m_pendingZoomPosition(false),
     m_zoomRatio(1),
     m_pendingZoomRatio(false),
     m_whiteBalance(kEdsWhiteBalance_Auto),
     m_pendingWhiteBalance(false),
+    m_stopTransfers(false),
+    m_transfersInFlight(0),
+    m_transferCount(0),
+    m_groupCommitInterval(20),
+    m_stopGroupCommit(false),
+    m_picturePreviews(false),
+    m_picturePreviewCallback(NULL),
     m_pictureCompleteCallback(NULL),
+    m_pictureDataCallback(NULL),
+    m_pictureDoneCallback(NULL),
+    m_checksum(Checksum::None),
+    m_durability(Unflushed),
+    m_keepPictureData(false),
+    m_derivativePool(NULL),
+    m_derivativeChannel(-1),
+    m_derivativeSequence(0),
     m_connected(false),
     m_cameraData(NULL)
 {
@@ -164,11 +280,20 @@ Camera::Camera() :
 Camera::~Camera()
 {
     disconnect();
+    setLiveViewDecoder(NULL, NULL, NULL);
+    setDerivatives(NULL, vector<Derivative>());
     delete m_liveView;
 }
 
 bool Camera::disconnect()
 {
+    stopTimelapse();
+    cancelBulb();
+    releaseFocus();
+    stopIngest();
+    stopTransferThreads();
+    m_manifest.close();
+
     if (m_connected) {
         // release session
         EdsError err;
@@ -314,6 +439,9 @@ bool Camera::connect()
         return false;
     }
 
+    if (! startTransferThreads())
+        return false;
+
     m_name = getName();
 
     if (s_modelData.count(m_name) > 0) {
@@ -367,7 +495,25 @@ EdsError EDSCALLBACK Camera::staticPropertyEventHandler(EdsPropertyEvent inEvent
 void Camera::objectEventHandler(EdsObjectEvent inEvent, EdsBaseRef inRef)
 {
     if (inEvent == kEdsObjectEvent_DirItemRequestTransfer) {
-        transferOneItem(inRef, m_picOutFile);
+        long long now = Utils::monotonicMicros();
+        // the camera is done exposing once it has something to hand us,
+        // unless it is in the middle of a burst
+        if (! m_burst.shutterHeld)
+            endExposure();
+        // a picture taken with the camera's own button says nothing about
+        // our shutter lag
+        bool forShot = ! m_shotDestinations.empty();
+        // download on the transfer thread so that we can keep handling
+        // events, and taking pictures, in the meantime
+        bool newFrame = false;
+        int transfer = queueTransfer(inRef, newFrame);
+        if (transfer && newFrame && forShot)
+            shutterLagPictureArrived(now);
+        if (transfer && newFrame && m_burst.recording)
+            burstFrameArrived(transfer, now);
+    } else if (inEvent == kEdsObjectEvent_DirItemCreated && m_manifest.isOpen()) {
+        // a sync keeps going for the rest of the session
+        dirItemCreated(inRef);
     } else {
         *s_err << "objectEventHandler: event " << inEvent;
         pushErrMsg(Debug);
@@ -378,6 +524,18 @@ void Camera::stateEventHandler(EdsStateEvent inEvent, EdsUInt32 inEventData)
 {
     *s_err << "stateEventHandler: event " << inEvent << ", parameter " << inEventData;
     pushErrMsg(Debug);
+
+    if (inEvent == kEdsStateEvent_CaptureError) {
+        // no transfer request is coming, so stop waiting for one, and
+        // don't let the next shot's picture end up where this one's should have
+        endExposure();
+        if (! m_shotDestinations.empty())
+            m_shotDestinations.pop_front();
+        m_lagShutterTime = 0;
+        // the camera won't be sending the rest of a burst either
+        releaseBurst();
+        resumeLiveView();
+    }
 }
 
 void Camera::propertyEventHandler(EdsPropertyEvent inEvent, EdsPropertyID inPropertyID, EdsUInt32 inParam)
@@ -724,7 +882,7 @@ void Camera::propertyEventHandler(EdsPropertyEvent inEvent, EdsPropertyID inProp
                 *s_err << "bogus notice from camera: live view now in WTF mode: " << inParam;
                 pushErrMsg(Warning);
             }
-            handleCameraIsReady();
+            handleLiveViewEvent(LiveView::CameraReady);
             break;
 		case kEdsPropID_Evf_Mode:
             *s_err << "Incoming property event: EvfMode";
@@ -777,319 +935,2720 @@ void Camera::propertyEventHandler(EdsPropertyEvent inEvent, EdsPropertyID inProp
     }
 }
 
-bool Camera::transferOneItem(EdsBaseRef inRef, string outfile)
+void Camera::transferThread(void * context)
 {
-    // transfer the image in memory to disk
-    EdsDirectoryItemInfo dirItemInfo;
-    EdsStreamRef outStream = NULL;
+    // the SDK wants COM on every thread that talks to it. the SDK thread
+    // is single-threaded because the camera's events come in as window
+    // messages that it pumps. this one gets no events and never pumps,
+    // which a single-threaded apartment would need, so it goes
+    // multithreaded. the SDK's refs are plain handles rather than COM
+    // interfaces, so nothing is marshaled between the two apartments.
+    CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    ((Camera *) context)->transferLoop();
+    CoUninitialize();
+}
 
-    EdsError err;
+void Camera::transferLoop()
+{
+    while (true) {
+        m_transferJobs.wait();
+
+        TransferItem item;
+        {
+            Lock lock(m_transferMutex);
+            // the queue is drained before we are told to stop
+            if (m_transferQueue.empty()) {
+                if (m_stopTransfers)
+                    return;
+                continue;
+            }
+            item = m_transferQueue.front();
+            m_transferQueue.pop();
+        }
 
-    err = EdsGetDirectoryItemInfo(inRef, &dirItemInfo);
+        FinishedTransfer finished;
+        finished.transfer = item.transfer;
+        finished.frame = item.frame;
+        finished.ingest = item.ingest;
+        finished.size = 0;
+        finished.requestTime = item.requestTime;
+        finished.downloadStartTime = 0;
+        finished.downloadEndTime = 0;
+        finished.picture.durability = Unflushed;
+        // the thumbnail is small, so it is worth the wait before the
+        // picture itself
+        if (item.wantPreview)
+            downloadPreview(item);
+        if (item.toMemory)
+            finished.success = transferOneItemToMemory(item, finished);
+        else
+            finished.success = transferOneItem(item, finished);
+        finished.finishTime = Utils::monotonicMicros();
+
+        EdsRelease(item.sdkRef);
+
+        Lock lock(m_transferMutex);
+
+        TransferStats & stats = m_transferStats;
+        if (finished.success) {
+            ++stats.transfersCompleted;
+            stats.bytesTransferred += finished.size;
+            long long downloadTime = finished.downloadEndTime - finished.downloadStartTime;
+            stats.downloadTime.add(downloadTime);
+            stats.requestToCompletion.add(finished.finishTime - finished.requestTime);
+            if (downloadTime > 0)
+                stats.throughput.add(finished.size * 1000000 / 1024 / downloadTime);
+        } else {
+            ++stats.transfersFailed;
+        }
 
-    if (err) {
-        *s_err << "Unable to get directory item info: " << ErrorMap::errorMsg(err);
-        pushErrMsg();
-        return false;
+        // poll() takes it from here, on the SDK thread, or the group commit
+        // thread for files waiting to be flushed. pictures in memory can be
+        // big, so swap the data instead of copying it.
+        bool flush = finished.success && ! item.toMemory && item.durability == GroupCommit;
+        deque<FinishedTransfer> & next = flush ? m_unflushedTransfers : m_finishedTransfers;
+        vector<unsigned char> data;
+        data.swap(finished.picture.data);
+        next.push_back(finished);
+        next.back().picture.data.swap(data);
+        if (flush)
+            m_groupCommitJobs.post();
     }
+}
+
+void Camera::groupCommitThread(void * context)
+{
+    ((Camera *) context)->groupCommitLoop();
+}
 
-    // get a temp file to write to
-    string tmpfile = tmpnam(NULL);
+void Camera::groupCommitLoop()
+{
+    while (true) {
+        m_groupCommitJobs.wait();
+
+        int interval;
+        {
+            Lock lock(m_transferMutex);
+            if (m_unflushedTransfers.empty()) {
+                if (m_stopGroupCommit)
+                    return;
+                continue;
+            }
+            interval = m_stopGroupCommit ? 0 : m_groupCommitInterval;
+        }
 
-    // this creates the outStream that is used by EdsDownload to actually
-    // grab and write out the file
-    err = EdsCreateFileStream(tmpfile.c_str(), kEdsFileCreateDisposition_CreateAlways, kEdsAccess_ReadWrite, &outStream);
+        // give the files that are still downloading a chance to join in,
+        // so that they share the wait for the disk
+        if (interval > 0)
+            Sleep(interval);
 
-    if (err) {
-        *s_err << "Unable to create file stream: " << ErrorMap::errorMsg(err);
-        pushErrMsg();
-        return false;
+        deque<FinishedTransfer> batch;
+        {
+            Lock lock(m_transferMutex);
+            batch.swap(m_unflushedTransfers);
+        }
+        // we were woken for the first of them. use up the posts for the
+        // rest, or we would wake up to an empty queue for each of them.
+        for (unsigned int i = 1; i < batch.size(); i++)
+            m_groupCommitJobs.wait(0);
+
+        // the OS has had all of them in its cache since we started
+        // sleeping, so most of the writing is done by the time we ask
+        for (unsigned int i = 0; i < batch.size(); i++) {
+            FinishedTransfer & finished = batch[i];
+            CompletedPicture & picture = finished.picture;
+            if (flushFile(finished.partialFile)) {
+                picture.durability = GroupCommit;
+            } else {
+                stringstream msg;
+                msg << "Unable to flush " << finished.partialFile << " to disk";
+                pushErrMsg(Warning, msg.str());
+            }
+
+            // only now does it get its real name. flushed or not, it is
+            // still the picture.
+            if (! moveFile(finished.partialFile, picture.filename, picture.durability == GroupCommit)) {
+                stringstream msg;
+                msg << "Unable to move downloaded picture to " << picture.filename << ", it was left in " << finished.partialFile;
+                pushErrMsg(Error, msg.str());
+                finished.success = false;
+            }
+
+            // the backups too, but they don't count towards durability
+            for (unsigned int j = 0; j < picture.copies.size(); j++) {
+                PictureCopy & copy = picture.copies[j];
+                const string & partial = finished.partialCopies[j];
+                if (! copy.success || partial.empty())
+                    continue;
+
+                bool flushed = flushFile(partial);
+                if (! flushed) {
+                    stringstream msg;
+                    msg << "Unable to flush the backup " << partial << " to disk";
+                    pushErrMsg(Warning, msg.str());
+                }
+                if (! moveFile(partial, copy.filename, flushed)) {
+                    copy.success = false;
+                    copy.error = "Unable to move it there, it was left in " + partial;
+                    stringstream msg;
+                    msg << "Unable to back up " << picture.cameraFilename << " to " << copy.filename << ": " << copy.error;
+                    pushErrMsg(Warning, msg.str());
+                }
+            }
+        }
+
+        long long now = Utils::monotonicMicros();
+        Lock lock(m_transferMutex);
+        for (unsigned int i = 0; i < batch.size(); i++) {
+            m_transferStats.groupCommitDelay.add(now - batch[i].finishTime);
+            vector<unsigned char> data;
+            data.swap(batch[i].picture.data);
+            m_finishedTransfers.push_back(batch[i]);
+            m_finishedTransfers.back().picture.data.swap(data);
+        }
     }
+}
+
+bool Camera::startTransferThreads()
+{
+    if (transferThreadsStarted())
+        return true;
 
-    if (! outStream) {
-        *s_err << "Create file stream didn't allocate a stream for us.";
+    m_stopGroupCommit = false;
+    if (! m_groupCommitThread.start(&Camera::groupCommitThread, this)) {
+        *s_err << "Unable to start the group commit thread";
         pushErrMsg();
         return false;
     }
 
-    // do the transfer
-    err = EdsDownload(inRef, dirItemInfo.size, outStream);
- 
-    if (err) {
-        *s_err << "Unable to download picture: " << ErrorMap::errorMsg(err);
-        pushErrMsg();
-        EdsRelease(outStream);
-        return false;
+    m_stopTransfers = false;
+    for (int i = 0; i < c_transferThreadCount; i++) {
+        if (! m_transferThreads[i].start(&Camera::transferThread, this)) {
+            *s_err << "Unable to start transfer thread " << i;
+            pushErrMsg();
+            stopTransferThreads();
+            return false;
+        }
     }
+    return true;
+}
 
-    err = EdsDownloadComplete(inRef);
+void Camera::stopTransferThreads()
+{
+    if (! transferThreadsStarted())
+        return;
+
+    {
+        Lock lock(m_transferMutex);
+        m_stopTransfers = true;
+    }
+    m_transferJobs.post(c_transferThreadCount);
+    // lets the downloads that are already queued finish
+    for (int i = 0; i < c_transferThreadCount; i++) {
+        if (m_transferThreads[i].started())
+            m_transferThreads[i].join();
+    }
+    // and then the files they left to be flushed
+    {
+        Lock lock(m_transferMutex);
+        m_stopGroupCommit = true;
+    }
+    m_groupCommitJobs.post();
+    if (m_groupCommitThread.started())
+        m_groupCommitThread.join();
+
+    // hand out whatever they produced, even frames still short of an item
+    finishTransfers();
+    while (! m_pendingFrames.empty()) {
+        map<int, PendingFrame>::iterator it = m_pendingFrames.begin();
+        it->second.expected = it->second.parts.size();
+        completeFrame(it->first);
+    }
+}
+
+bool Camera::transferThreadsStarted() const
+{
+    // it starts first
+    return m_groupCommitThread.started();
+}
 
+int Camera::queueTransfer(EdsBaseRef inRef, bool & newFrame)
+{
+    // the ref belongs to the SDK and goes away when the event handler
+    // returns unless we hang on to it
+    EdsError err = EdsRetain(inRef);
     if (err) {
-        *s_err << "Unable to finish downloading picture: " << ErrorMap::errorMsg(err);
+        *s_err << "Unable to retain directory item for transfer: " << ErrorMap::errorMsg(err);
         pushErrMsg();
-        EdsRelease(outStream);
-        return false;
+        return 0;
     }
 
-    // clean up
-    err = EdsRelease(outStream);
-
+    // we need the name and group of the item to tell which frame it is part of
+    EdsDirectoryItemInfo dirItemInfo;
+    err = EdsGetDirectoryItemInfo(inRef, &dirItemInfo);
     if (err) {
-        *s_err << "Unable to release out stream after downloading: " << ErrorMap::errorMsg(err);
+        *s_err << "Unable to get directory item info: " << ErrorMap::errorMsg(err);
         pushErrMsg(Warning);
+        dirItemInfo.groupID = 0;
+        dirItemInfo.szFileName[0] = '\0';
     }
 
-    // make sure we don't overwrite files
-    ensurePathExists(getDirectoryName(outfile));
-    outfile = makeUnique(outfile);
-    moveFile(tmpfile, outfile);
-
-    resumeLiveView();
-    handleCameraIsReady();
+    TransferItem item;
+    item.sdkRef = inRef;
+    item.transfer = ++m_transferCount;
+    item.requestTime = Utils::monotonicMicros();
+    item.ingest = false;
+
+    // the second item of a RAW+JPEG frame goes with the first
+    newFrame = true;
+    map<int, PendingFrame>::iterator current = m_pendingFrames.find(m_currentFrame);
+    if (current != m_pendingFrames.end() && current->second.arrived < current->second.expected) {
+        EdsUInt32 group = current->second.groupID;
+        if (group == 0 || dirItemInfo.groupID == 0 || group == dirItemInfo.groupID)
+            newFrame = false;
+        else
+            closeFrame(m_currentFrame);
+    }
 
-    if (m_pictureCompleteCallback)
-        m_pictureCompleteCallback(outfile);
+    if (newFrame) {
+        PendingFrame frame;
+        bool newShot = nextPictureDestination(frame.outFile, frame.toMemory);
+        frame.expected = itemsPerFrame();
+        frame.arrived = 0;
+        frame.transfer = item.transfer;
+        frame.groupID = dirItemInfo.groupID;
 
-    m_pictureDoneQueue.push(outfile);
+        m_currentFrame = ++m_frameCount;
+        m_pendingFrames[m_currentFrame] = frame;
 
-    return true;
-}
+        // a picture for a different shot than the burst's means the burst is over
+        if (newShot && m_burst.recording && ! m_burst.shutterHeld)
+            m_burst.recording = false;
+    }
 
-void Camera::handleCameraIsReady()
-{
-    switch (m_liveView->m_state) {
-        case LiveView::On:
-        case LiveView::Off:
-        case LiveView::Paused:
-            break;
-        case LiveView::WaitingToStart:
-            m_liveView->m_state = LiveView::On;
-            switch (m_liveView->m_desiredNewState) {
-                case LiveView::Off:
-                    stopLiveView();
-                    break;
-                case LiveView::On:
-                    break;
-                case LiveView::Paused:
-                    pauseLiveView();
-                    break;
-                default:
-                    assert(false);
-            }
-            break;
-        case LiveView::WaitingToStop:
-            *s_err << "Finished stopping live view. Let's decide what to do.";
-            pushErrMsg(Debug);
-            m_liveView->m_state = LiveView::Off;
-            switch (m_liveView->m_desiredNewState) {
-                case LiveView::Off:
-                    *s_err << "we want it off, so we don't have to do anything.";
-                    pushErrMsg(Debug);
-                    break;
-                case LiveView::On:
-                    *s_err << "we want it on, so we call startLiveView";
-                    pushErrMsg(Debug);
-                    startLiveView();
-                    break;
-                case LiveView::Paused:
-                    *s_err << "we want it paused, so we set state to paused";
-                    pushErrMsg(Debug);
-                    m_liveView->m_state = LiveView::Paused;
-                    break;
-                default:
-                    assert(false);
-            }
-            break;
+    // one preview per frame is plenty
+    item.wantPreview = m_picturePreviews && newFrame;
+    item.checksum = m_checksum;
+    item.durability = m_durability;
+    item.backupFolders = m_backupFolders;
+    item.keepData = m_keepPictureData;
+    item.derivatives = m_derivatives;
+
+    PendingFrame & frame = m_pendingFrames[m_currentFrame];
+    ++frame.arrived;
+    frame.lastArrival = item.requestTime;
+    item.frame = m_currentFrame;
+    item.toMemory = frame.toMemory;
+    if (! item.toMemory)
+        item.outFile = withCameraExtension(frame.outFile, dirItemInfo.szFileName);
+
+    ++m_transfersInFlight;
+    {
+        Lock lock(m_transferMutex);
+        m_transferQueue.push(item);
     }
+    m_transferJobs.post();
+
+    return item.transfer;
 }
 
-bool Camera::pauseLiveView()
+void Camera::finishTransfers()
 {
-    switch (m_liveView->m_state) {
-        case LiveView::Paused:
-        case LiveView::Off:
-            // nothing to do
-            return true;
-        case LiveView::On:
-            if (_stopLiveView()) {
-                m_liveView->m_desiredNewState = LiveView::Paused;
-                return true;
-            } else {
-                return false;
-            }
-        case LiveView::WaitingToStart:
-        case LiveView::WaitingToStop:
-            m_liveView->m_desiredNewState = LiveView::Paused;
-            return true;
+    // the camera may have changed its image quality behind our back, so
+    // don't wait forever for the second item of a frame
+    bool gaveUp = false;
+    map<int, PendingFrame>::iterator current = m_pendingFrames.find(m_currentFrame);
+    if (current != m_pendingFrames.end() && current->second.arrived < current->second.expected
+        && Utils::monotonicMicros() - current->second.lastArrival > c_sleepTimeout * 1000LL)
+    {
+        *s_err << "Gave up waiting for the rest of picture " << current->second.transfer;
+        pushErrMsg(Warning);
+        closeFrame(m_currentFrame);
+        gaveUp = true;
     }
-    assert(false);
-    return false;
-}
 
-bool Camera::resumeLiveView()
-{
-    *s_err << "Attempting to resume live view.";
-    pushErrMsg(Debug);
-    switch (m_liveView->m_state) {
-        case LiveView::Off:
-            *s_err << "Live view is off, we don't need to resume.";
-            pushErrMsg(Debug);
-            return true;
-        case LiveView::On:
-            *s_err << "Live view already on, don't need to do anything.";
-            pushErrMsg(Debug);
-            return true;
-        case LiveView::Paused:
-            // this is the normal way to resume
-            *s_err << "live view is paused, so we call _startLiveView";
-            pushErrMsg(Debug);
-            if (! _startLiveView())
-                return false;
-            m_liveView->m_desiredNewState = LiveView::On;
-        case LiveView::WaitingToStop:
-            *s_err << "Already waiting to stop live view, so we change the next desired state to On";
-            pushErrMsg(Debug);
-            m_liveView->m_desiredNewState = LiveView::On;
-            return true;
-        case LiveView::WaitingToStart:
-            *s_err << "Already waiting to start live view, so we change the next desired state to On";
-            pushErrMsg(Debug);
-            m_liveView->m_desiredNewState = LiveView::On;
-            return true;
+    deque<FinishedTransfer> finished;
+    deque<PicturePreview> previews;
+    {
+        Lock lock(m_transferMutex);
+        finished.swap(m_finishedTransfers);
+        previews.swap(m_newPreviews);
     }
-    assert(false);
-    return false;
-}
 
-bool Camera::setComputerCapabilities()
-{
-    // tell the camera how much disk space we have left
-    EdsCapacity caps;
+    // previews first, they are what people are waiting for
+    while (! previews.empty()) {
+        previewDone(previews.front());
+        previews.pop_front();
+    }
 
-    caps.reset = true;
-    caps.bytesPerSector = 512;
-    caps.numberOfFreeClusters = 2147483647; // arbitrary large number
-    EdsError err = EdsSetCapacity(m_cam, caps);
+    if (finished.empty() && ! gaveUp)
+        return;
 
-    if (err) {
-        *s_err << "Unable to set computer capabilities: " << ErrorMap::errorMsg(err);
-        pushErrMsg();
-        return false;
+    bool pictureFinished = gaveUp;
+    while (! finished.empty()) {
+        FinishedTransfer & transfer = finished.front();
+        if (transfer.ingest) {
+            ingestFileDone(transfer);
+            finished.pop_front();
+            continue;
+        }
+        --m_transfersInFlight;
+        pictureFinished = true;
+
+        map<int, PendingFrame>::iterator it = m_pendingFrames.find(transfer.frame);
+        if (it != m_pendingFrames.end()) {
+            // pictures in memory can be big, so swap the data instead of copying it
+            vector<FinishedTransfer> & parts = it->second.parts;
+            parts.push_back(transfer);
+            parts.back().picture.data.swap(transfer.picture.data);
+            completeFrame(transfer.frame);
+        }
+        finished.pop_front();
     }
 
-    return true;
+    // the camera does not always tell us when live view comes back after a
+    // picture, so check right away. not when we are shutting down, though.
+    if (pictureFinished && m_transfersInFlight == 0 && m_pendingFrames.empty() && m_shotDestinations.empty()
+        && ! m_burst.shutterHeld && transferThreadsStarted())
+    {
+        resumeLiveView();
+        handleLiveViewEvent(LiveView::CameraReady);
+    }
 }
 
-bool Camera::takeSinglePicture(string outFile)
+int Camera::itemsPerFrame()
 {
-    if (! pauseLiveView())
-        return false;
-    m_picOutFile = outFile;
-
-    if (! setComputerCapabilities())
-        return false;
-
-    *s_err << "Sending take picture command.";
-    pushErrMsg(Debug);
-    // take a picture with the camera and save it to outfile
-    EdsError err = EdsSendCommand(m_cam, kEdsCameraCommand_TakePicture, 0);
-
-    if (err == EDS_ERR_OBJECT_NOTREADY) {
-        *s_err << "unable to take picture, camera not ready";
+    // the low 16 bits describe the secondary image. its type is
+    // kEdsImageType_Unknown unless the camera saves two files.
+    EdsUInt32 quality = 0;
+    EdsError err = EdsGetPropertyData(m_cam, kEdsPropID_ImageQuality, 0, sizeof(EdsUInt32), &quality);
+    if (err) {
+        *s_err << "Unable to get image quality: " << ErrorMap::errorMsg(err);
         pushErrMsg(Warning);
-        return false;
-    } else if (err) {
-        *s_err << "unable to take picture: " << ErrorMap::errorMsg(err);
-        pushErrMsg();
-        return false;
+        return 1;
     }
 
-    return true;
+    EdsUInt32 secondaryType = (quality >> 4) & 0xf;
+    if (secondaryType == kEdsImageType_Unknown || secondaryType == 0xf)
+        return 1;
+    return 2;
 }
 
-EdsPoint Camera::zoomPosition() const
+void Camera::closeFrame(int frame)
 {
-    return m_zoomPosition;
-}
+    map<int, PendingFrame>::iterator it = m_pendingFrames.find(frame);
+    if (it == m_pendingFrames.end())
+        return;
 
-void Camera::setZoomPosition(EdsPoint position)
-{
-    m_pendingZoomPoint = position;
-    m_pendingZoomPosition = true;
+    it->second.expected = it->second.arrived;
+    completeFrame(frame);
 }
 
-int Camera::zoomRatio() const
+void Camera::completeFrame(int frame)
 {
-    return m_zoomRatio;
-}
+    map<int, PendingFrame>::iterator it = m_pendingFrames.find(frame);
+    if (it == m_pendingFrames.end())
+        return;
 
-void Camera::setZoomRatio(int zoomRatio)
-{
-    m_zoomRatio = zoomRatio;
-    m_pendingZoomRatio = true;
-}
+    PendingFrame & pending = it->second;
+    if ((int) pending.parts.size() < pending.expected)
+        return;
 
-EdsWhiteBalance Camera::whiteBalance() const
-{
-    EdsError err = EdsGetPropertyData(m_cam, kEdsPropID_WhiteBalance, 0, sizeof(m_whiteBalance), (EdsVoid *) &m_whiteBalance);
-    if (err) {
-        *s_err << "Unable to get white balance: " << ErrorMap::errorMsg(err);
-        pushErrMsg();
+    // the JPEG, if there is one, goes first because that's what most
+    // people want to look at
+    vector<FinishedTransfer> & parts = pending.parts;
+    for (unsigned int i = 1; i < parts.size(); i++) {
+        string ext = getExtension(parts[i].picture.cameraFilename);
+        if (ext == ".JPG" || ext == ".jpg") {
+            std::swap(parts[0], parts[i]);
+            break;
+        }
     }
-    return m_whiteBalance;
-}
 
-void Camera::setWhiteBalance(EdsWhiteBalance whiteBalance) 
-{
-    m_whiteBalance = whiteBalance;
-    m_pendingWhiteBalance = true;
+    CompletedPicture picture;
+    bool havePicture = false;
+    long long transferTime = 0;
+    for (unsigned int i = 0; i < parts.size(); i++) {
+        if (! parts[i].success)
+            continue;
+        if (parts[i].finishTime > transferTime)
+            transferTime = parts[i].finishTime;
+
+        PictureFile & part = parts[i].picture;
+        if (! havePicture) {
+            picture.PictureFile::swap(part);
+            havePicture = true;
+        } else {
+            picture.companions.push_back(PictureFile());
+            picture.companions.back().swap(part);
+        }
+    }
+
+    if (m_burst.recording && havePicture)
+        burstFrameTransferred(pending.transfer, transferTime, picture.filename);
+
+    if (frame == m_currentFrame)
+        m_currentFrame = 0;
+    m_pendingFrames.erase(it);
+
+    if (havePicture)
+        pictureDone(picture);
 }
 
-Camera::MeteringMode Camera::meteringMode() const
+string Camera::withCameraExtension(string outFile, const string & cameraFilename)
 {
-    EdsUInt32 mode;
-    EdsError err = EdsGetPropertyData(m_cam, kEdsPropID_MeteringMode, 0, sizeof(EdsUInt32), (EdsVoid *) &mode);
-    if (err) {
-        *s_err << "Unable to get metering mode: " << ErrorMap::errorMsg(err);
-        pushErrMsg();
+    string ext = getExtension(cameraFilename);
+    if (ext.empty())
+        return outFile;
+
+    // keep the caller's spelling if it is the same extension
+    string current = getExtension(outFile);
+    if (current.length() == ext.length()) {
+        bool same = true;
+        for (unsigned int i = 0; i < ext.length(); i++) {
+            if (tolower(current[i]) != tolower(ext[i]))
+                same = false;
+        }
+        if (same)
+            return outFile;
     }
-    return (MeteringMode) mode;
+
+    string lowered = ext;
+    for (unsigned int i = 0; i < lowered.length(); i++)
+        lowered[i] = tolower(lowered[i]);
+
+    return outFile.substr(0, outFile.length() - current.length()) + lowered;
 }
 
-void Camera::setMeteringMode(MeteringMode mode)
+// runs on the transfer thread, so no s_err in here
+bool Camera::transferOneItem(const TransferItem & item, FinishedTransfer & result)
 {
-    EdsUInt32 edsMode = mode;
-    EdsError err = EdsSetPropertyData(m_cam, kEdsPropID_MeteringMode, 0, sizeof(EdsUInt32), &edsMode);
+    string outfile = item.outFile;
+    EdsDirectoryItemInfo dirItemInfo;
+    stringstream msg;
+
+    EdsError err = EdsGetDirectoryItemInfo(item.sdkRef, &dirItemInfo);
+
     if (err) {
-        *s_err << "Unable to set metering mode: " << ErrorMap::errorMsg(err);
-        pushErrMsg(Warning);
+        msg << "Unable to get directory item info: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Error, msg.str());
+        return false;
     }
-}
 
-Camera::DriveMode Camera::driveMode() const
-{
-    EdsUInt32 mode;
-    EdsError err = EdsGetPropertyData(m_cam, kEdsPropID_DriveMode, 0, sizeof(EdsUInt32), (EdsVoid *) &mode);
-    if (err) {
-        *s_err << "Unable to get drive mode: " << ErrorMap::errorMsg(err);
-        pushErrMsg();
+    // download straight into the destination folder under a temporary
+    // name. renaming it within the folder is cheap, and the picture only
+    // shows up under its real name once it is complete.
+    ensurePathExists(getDirectoryName(outfile));
+    string tmpfile = createUniqueFile(outfile + c_partialFileExtension);
+    if (tmpfile.empty()) {
+        // we can't create files there. download to the temp folder instead
+        // and let moveFile copy it over.
+        msg << "Unable to create a file next to " << outfile << ", downloading to the temp folder";
+        pushErrMsg(Warning, msg.str());
+        msg.str("");
+        tmpfile = tmpnam(NULL);
     }
-    return (DriveMode) mode;
-}
 
-void Camera::setDriveMode(DriveMode mode)
-{
-    EdsUInt32 edsMode = mode;
-    EdsError err = EdsSetPropertyData(m_cam, kEdsPropID_DriveMode, 0, sizeof(EdsUInt32), &edsMode);
-    if (err) {
-        *s_err << "Unable to set drive mode: " << ErrorMap::errorMsg(err);
-        pushErrMsg(Warning);
+    // the camera tells us how big the file is, so the whole thing is
+    // set aside on disk before the first byte arrives. big ones get mapped
+    // into memory and the SDK writes straight into the page cache.
+    MappedFileSink mapped(tmpfile, dirItemInfo.size);
+    FileSink file(tmpfile);
+    mapped.setFlush(item.durability == FlushEachFile);
+    file.setFlush(item.durability == FlushEachFile);
+    Sink * sink = NULL;
+    if (dirItemInfo.size >= c_mappedFileSize) {
+        if (mapped.open()) {
+            sink = &mapped;
+        } else {
+            msg << mapped.error() << ", writing it the usual way";
+            pushErrMsg(Debug, msg.str());
+            msg.str("");
+        }
+    }
+    if (! sink) {
+        if (! file.open(dirItemInfo.size)) {
+            pushErrMsg(Error, file.error());
+            remove(tmpfile.c_str());
+            return false;
+        }
+        sink = &file;
     }
-}
 
-Camera::AFMode Camera::afMode() const
-{
-    EdsUInt32 mode;
+    // the backups, and the copy in memory if there is one, are fed the
+    // same bytes in the same pass. only the file above has to make it for
+    // the picture to.
+    TeeSink tee;
+    tee.add(sink);
+
+    vector<PictureCopy> & copies = result.picture.copies;
+    result.partialCopies.resize(item.backupFolders.size());
+    vector<FileSink *> backups;
+    // which sink of the tee each backup is, or -1
+    vector<int> backupBranches;
+    for (unsigned int i = 0; i < item.backupFolders.size(); i++) {
+        PictureCopy copy;
+        copy.filename = pathCombine(item.backupFolders[i], getFileTitle(outfile));
+        copy.success = false;
+
+        FileSink * backup = NULL;
+        ensurePathExists(item.backupFolders[i]);
+        string backupTmp = createUniqueFile(copy.filename + c_partialFileExtension);
+        if (backupTmp.empty()) {
+            copy.error = "Unable to create a file there";
+        } else {
+            backup = new FileSink(backupTmp);
+            backup->setFlush(item.durability == FlushEachFile);
+            if (! backup->open(dirItemInfo.size)) {
+                copy.error = backup->error();
+                delete backup;
+                backup = NULL;
+                remove(backupTmp.c_str());
+            }
+        }
+
+        copies.push_back(copy);
+        backups.push_back(backup);
+        backupBranches.push_back(backup ? tee.sinkCount() : -1);
+        if (backup)
+            tee.add(backup, false);
+    }
+
+    // JPEGs that get derivatives are kept on the way in too, so that the
+    // pool doesn't have to read them back
+    string ext = getExtension(dirItemInfo.szFileName);
+    bool derivatives = ! item.derivatives.empty() && (ext == ".JPG" || ext == ".jpg");
+
+    vector<unsigned char> & data = result.picture.data;
+    if (item.keepData || derivatives)
+        data.resize(dirItemInfo.size);
+    MemorySink memory(data.empty() ? NULL : &data[0], data.size());
+    int memoryBranch = -1;
+    if (! data.empty()) {
+        memoryBranch = tee.sinkCount();
+        tee.add(&memory, false);
+    }
+
+    bool downloaded = downloadItem(item, dirItemInfo, tee, result);
+
+    for (unsigned int i = 0; i < backups.size(); i++) {
+        PictureCopy & copy = copies[i];
+        if (downloaded && backups[i]) {
+            if (tee.sinkFailed(backupBranches[i])) {
+                copy.error = tee.sinkError(backupBranches[i]);
+            } else if (item.durability == GroupCommit) {
+                // renamed by the group commit thread, like the picture
+                copy.filename = makeUnique(copy.filename);
+                copy.success = true;
+                result.partialCopies[i] = backups[i]->path();
+            } else {
+                copy.filename = makeUnique(copy.filename);
+                copy.success = moveFile(backups[i]->path(), copy.filename, item.durability == FlushEachFile);
+                if (! copy.success)
+                    copy.error = "Unable to move it there, it was left in " + backups[i]->path();
+            }
+        }
+        if (downloaded && ! copy.success) {
+            msg << "Unable to back up " << dirItemInfo.szFileName << " to " << copy.filename << ": " << copy.error;
+            pushErrMsg(Warning, msg.str());
+            msg.str("");
+        }
+        delete backups[i];
+    }
+
+    if (memoryBranch != -1 && (! downloaded || tee.sinkFailed(memoryBranch)))
+        data.clear();
+
+    if (! downloaded)
+        return false;
+
+    if (item.checksum != Checksum::None && result.picture.checksum.empty()) {
+        pushErrMsg(Debug, "The download didn't go in order, reading it back for its checksum");
+        result.picture.checksum = checksumOfFile(tmpfile, item.checksum);
+    }
+
+    // the file was just written, so its first pages are still in the cache
+    // and mapping it doesn't touch the disk
+    if (! data.empty())
+        Exif::parse(&data[0], data.size(), result.picture.metadata);
+    else
+        Exif::parseFile(tmpfile, result.picture.metadata);
+
+    // make sure we don't overwrite files. moveFile won't either, so if
+    // somebody takes the name in the meantime we only lose the rename.
+    outfile = makeUnique(outfile);
+    if (item.durability == GroupCommit) {
+        // the group commit thread renames it once it is on the disk, so
+        // that nothing a crash can lose shows up under its real name
+        result.partialFile = tmpfile;
+    } else if (! moveFile(tmpfile, outfile, item.durability == FlushEachFile)) {
+        // with the picture saved to the host only, that file is the only
+        // copy there is, so it stays where it is
+        msg << "Unable to move downloaded picture to " << outfile << ", it was left in " << tmpfile;
+        pushErrMsg(Error, msg.str());
+        return false;
+    }
+
+    result.picture.filename = outfile;
+    // the flush happened in the sink, before the rename. the rename is
+    // journaled by NTFS, so it doesn't need one of its own.
+    if (item.durability == FlushEachFile)
+        result.picture.durability = FlushEachFile;
+
+    if (derivatives) {
+        if (data.empty()) {
+            msg << "Unable to keep " << dirItemInfo.szFileName << " in memory for its derivatives";
+            pushErrMsg(Warning, msg.str());
+            msg.str("");
+        } else if (item.keepData) {
+            vector<unsigned char> copy(data);
+            queueDerivatives(outfile, copy, item.derivatives);
+        } else {
+            // nobody else wants the bytes
+            queueDerivatives(outfile, data, item.derivatives);
+            data.clear();
+        }
+    }
+
+    return true;
+}
+
+// runs on the transfer thread, so no s_err in here
+bool Camera::transferOneItemToMemory(const TransferItem & item, FinishedTransfer & result)
+{
+    CompletedPicture & picture = result.picture;
+    EdsDirectoryItemInfo dirItemInfo;
+    stringstream msg;
+
+    EdsError err = EdsGetDirectoryItemInfo(item.sdkRef, &dirItemInfo);
+
+    if (err) {
+        msg << "Unable to get directory item info: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Error, msg.str());
+        return false;
+    }
+
+    if (dirItemInfo.size == 0) {
+        pushErrMsg(Error, "Camera says the picture is empty");
+        return false;
+    }
+
+    // we know how big the picture is, so have the SDK download it straight
+    // into a buffer of our own rather than one we would have to copy out of
+    picture.data.resize(dirItemInfo.size);
+    MemorySink memory(&picture.data[0], picture.data.size());
+
+    if (! downloadItem(item, dirItemInfo, memory, result)) {
+        picture.data.clear();
+        return false;
+    }
+
+    if (picture.data.empty())
+        return true;
+
+    // it's all in memory, so if the checksum missed anything, it's cheap
+    // to do again
+    if (item.checksum != Checksum::None && picture.checksum.empty()) {
+        Checksum checksum(item.checksum);
+        checksum.update(&picture.data[0], picture.data.size());
+        picture.checksum = checksum.digest();
+    }
+
+    Exif::parse(&picture.data[0], picture.data.size(), picture.metadata);
+
+    return true;
+}
+
+// runs on the transfer thread, so no s_err in here
+bool Camera::downloadItem(const TransferItem & item, const EdsDirectoryItemInfo & dirItemInfo, Sink & sink, FinishedTransfer & result)
+{
+    EdsBaseRef inRef = item.sdkRef;
+    stringstream msg;
+
+    // the SDK writes into the sink through this stream, and the checksum
+    // is worked out on the way
+    StreamAdapter stream(sink, item.checksum);
+    EdsError err = stream.open();
+
+    if (err) {
+        msg << "Unable to create stream: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Error, msg.str());
+        sink.abort();
+        return false;
+    }
+
+    result.size = dirItemInfo.size;
+    result.picture.cameraFilename = dirItemInfo.szFileName;
+
+    ProgressContext progress;
+    progress.progress.transfer = item.transfer;
+    progress.progress.cameraFilename = dirItemInfo.szFileName;
+    progress.progress.size = dirItemInfo.size;
+    watchProgress(stream.stream(), progress);
+
+    // do the transfer
+    result.downloadStartTime = Utils::monotonicMicros();
+    err = EdsDownload(inRef, dirItemInfo.size, stream.stream());
+    result.downloadEndTime = Utils::monotonicMicros();
+
+    if (err) {
+        msg << "Unable to download picture: " << ErrorMap::errorMsg(err);
+        if (! stream.error().empty())
+            msg << " (" << stream.error() << ")";
+        pushErrMsg(Error, msg.str());
+        stream.close();
+        sink.abort();
+        return false;
+    }
+
+    err = EdsDownloadComplete(inRef);
+
+    if (err) {
+        msg << "Unable to finish downloading picture: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Error, msg.str());
+        stream.close();
+        sink.abort();
+        return false;
+    }
+
+    // clean up
+    err = stream.close();
+
+    if (err) {
+        msg << "Unable to release out stream after downloading: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning, msg.str());
+        msg.str("");
+    }
+
+    if (! sink.finish()) {
+        pushErrMsg(Error, sink.error());
+        sink.abort();
+        return false;
+    }
+
+    if (stream.checksumValid())
+        result.picture.checksum = stream.digest();
+
+    return true;
+}
+
+string Camera::checksumOfFile(const string & filename, Checksum::Algorithm algorithm)
+{
+    FILE * in = fopen(filename.c_str(), "rb");
+    if (! in)
+        return string();
+
+    Checksum checksum(algorithm);
+    vector<char> buffer(0x100000);
+    size_t count;
+    while ((count = fread(&buffer[0], 1, buffer.size(), in)) > 0)
+        checksum.update(&buffer[0], count);
+    bool failed = ferror(in) != 0;
+    fclose(in);
+
+    return failed ? string() : checksum.digest();
+}
+
+// runs on the transfer thread, so no s_err in here
+void Camera::downloadPreview(const TransferItem & item)
+{
+    EdsDirectoryItemInfo dirItemInfo;
+    EdsStreamRef stream = NULL;
+    stringstream msg;
+
+    EdsError err = EdsGetDirectoryItemInfo(item.sdkRef, &dirItemInfo);
+
+    if (err) {
+        msg << "Unable to get directory item info for preview: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning, msg.str());
+        return;
+    }
+
+    // we don't know how big the thumbnail is, so let the SDK grow the buffer
+    err = EdsCreateMemoryStream(0, &stream);
+
+    if (err || ! stream) {
+        msg << "Unable to create memory stream for preview: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning, msg.str());
+        return;
+    }
+
+    err = EdsDownloadThumbnail(item.sdkRef, stream);
+
+    if (err) {
+        // some files, like movies, have no thumbnail. not a problem for
+        // the picture itself.
+        msg << "Unable to download preview of " << dirItemInfo.szFileName << ": " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning, msg.str());
+        EdsRelease(stream);
+        return;
+    }
+
+    EdsUInt32 length = 0;
+    EdsVoid * pointer = NULL;
+    EdsGetLength(stream, &length);
+    EdsGetPointer(stream, &pointer);
+
+    PicturePreview preview;
+    preview.transfer = item.transfer;
+    preview.cameraFilename = dirItemInfo.szFileName;
+    if (pointer && length > 0)
+        preview.data.assign((unsigned char *) pointer, (unsigned char *) pointer + length);
+    preview.requestTime = item.requestTime;
+    preview.previewTime = Utils::monotonicMicros();
+
+    EdsRelease(stream);
+
+    if (preview.data.empty())
+        return;
+
+    Lock lock(m_transferMutex);
+    m_transferStats.requestToPreview.add(preview.previewTime - preview.requestTime);
+    m_newPreviews.push_back(preview);
+}
+
+void Camera::watchProgress(EdsStreamRef stream, ProgressContext & context)
+{
+    context.camera = this;
+    context.progress.percent = 0;
+    context.progress.bytesDone = 0;
+    context.progress.elapsed = 0;
+    context.startTime = Utils::monotonicMicros();
+
+    EdsError err = EdsSetProgressCallback(stream, &staticProgressCallback, kEdsProgressOption_Periodically, &context);
+    if (err) {
+        stringstream msg;
+        msg << "Unable to watch download progress: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning, msg.str());
+    }
+}
+
+EdsError EDSCALLBACK Camera::staticProgressCallback(EdsUInt32 inPercent, EdsVoid * inContext, EdsBool * outCancel)
+{
+    if (! inContext)
+        return 0;
+
+    ProgressContext * context = (ProgressContext *) inContext;
+    TransferProgress & progress = context->progress;
+    progress.percent = inPercent;
+    progress.bytesDone = progress.size * inPercent / 100;
+    progress.elapsed = Utils::monotonicMicros() - context->startTime;
+    context->camera->reportProgress(progress);
+
+    return 0;
+}
+
+void Camera::reportProgress(const TransferProgress & progress)
+{
+    Lock lock(m_transferMutex);
+    m_transferProgress.push_back(progress);
+    while ((int) m_transferProgress.size() > c_maxTransferProgress)
+        m_transferProgress.pop_front();
+}
+
+bool Camera::popTransferProgress(TransferProgress & progress)
+{
+    Lock lock(m_transferMutex);
+    if (m_transferProgress.empty())
+        return false;
+
+    progress = m_transferProgress.front();
+    m_transferProgress.pop_front();
+    return true;
+}
+
+Camera::TransferStats Camera::transferStats() const
+{
+    Lock lock(m_transferMutex);
+    return m_transferStats;
+}
+
+void Camera::resetTransferStats()
+{
+    Lock lock(m_transferMutex);
+    m_transferStats = TransferStats();
+}
+
+void Camera::pictureDone(CompletedPicture & picture)
+{
+    if (picture.filename.empty()) {
+        if (m_pictureDataCallback)
+            m_pictureDataCallback(picture);
+    } else {
+        if (m_pictureCompleteCallback)
+            m_pictureCompleteCallback(picture.filename);
+    }
+    if (m_pictureDoneCallback)
+        m_pictureDoneCallback(picture);
+
+    Lock lock(m_pictureDoneMutex);
+    m_pictureDoneQueue.push(CompletedPicture());
+    m_pictureDoneQueue.back().swap(picture);
+}
+
+void Camera::PictureFile::swap(PictureFile & other)
+{
+    filename.swap(other.filename);
+    cameraFilename.swap(other.cameraFilename);
+    data.swap(other.data);
+    checksum.swap(other.checksum);
+    std::swap(durability, other.durability);
+    copies.swap(other.copies);
+    std::swap(metadata, other.metadata);
+}
+
+void Camera::CompletedPicture::swap(CompletedPicture & other)
+{
+    PictureFile::swap(other);
+    companions.swap(other.companions);
+}
+
+void Camera::previewDone(PicturePreview & preview)
+{
+    if (m_picturePreviewCallback)
+        m_picturePreviewCallback(preview);
+
+    Lock lock(m_pictureDoneMutex);
+    m_previewQueue.push_back(preview);
+    while ((int) m_previewQueue.size() > c_maxPicturePreviews)
+        m_previewQueue.pop_front();
+}
+
+const Camera::LiveView::Transition Camera::LiveView::c_transitions[] = {
+    // state            event               action          desiredNewState
+    {Off,               StartRequested,     RequestStart,   On},
+
+    {WaitingToStart,    StartRequested,     NoAction,       On},
+    {WaitingToStart,    StopRequested,      NoAction,       Off},
+    {WaitingToStart,    PauseRequested,     NoAction,       Paused},
+    {WaitingToStart,    ResumeRequested,    NoAction,       On},
+    {WaitingToStart,    CameraReady,        Arrive,         Unchanged},
+    {WaitingToStart,    TimedOut,           Recover,        Unchanged},
+
+    {On,                StopRequested,      RequestStop,    Off},
+    {On,                PauseRequested,     RequestStop,    Paused},
+
+    {Paused,            StopRequested,      TurnOff,        Off},
+    {Paused,            ResumeRequested,    RequestStart,   On},
+
+    {WaitingToStop,     StartRequested,     NoAction,       On},
+    {WaitingToStop,     StopRequested,      NoAction,       Off},
+    {WaitingToStop,     PauseRequested,     NoAction,       Paused},
+    {WaitingToStop,     ResumeRequested,    NoAction,       On},
+    {WaitingToStop,     CameraReady,        Arrive,         Unchanged},
+    {WaitingToStop,     TimedOut,           Recover,        Unchanged},
+};
+
+const int Camera::LiveView::c_transitionCount = sizeof(c_transitions) / sizeof(c_transitions[0]);
+
+const Camera::LiveView::Transition * Camera::LiveView::findTransition(State state, Event event)
+{
+    for (int i = 0; i < c_transitionCount; i++) {
+        if (c_transitions[i].state == state && c_transitions[i].event == event)
+            return &c_transitions[i];
+    }
+    return NULL;
+}
+
+const char * Camera::LiveView::stateName(State state)
+{
+    switch (state) {
+        case Off: return "Off";
+        case WaitingToStart: return "WaitingToStart";
+        case On: return "On";
+        case Paused: return "Paused";
+        case WaitingToStop: return "WaitingToStop";
+        case Unchanged: return "Unchanged";
+    }
+    return "?";
+}
+
+const char * Camera::LiveView::eventName(Event event)
+{
+    switch (event) {
+        case StartRequested: return "StartRequested";
+        case StopRequested: return "StopRequested";
+        case PauseRequested: return "PauseRequested";
+        case ResumeRequested: return "ResumeRequested";
+        case CameraReady: return "CameraReady";
+        case TimedOut: return "TimedOut";
+    }
+    return "?";
+}
+
+void Camera::LiveView::accountTimeInState()
+{
+    long long now = Utils::monotonicMicros();
+    m_stats.timeInState[stateName(m_state)] += now - m_stateAccountedAt;
+    m_stateAccountedAt = now;
+}
+
+void Camera::LiveView::setState(State state)
+{
+    accountTimeInState();
+
+    long long elapsed = m_stateAccountedAt - m_stateEnteredAt;
+    if (m_state == WaitingToStart && state == On)
+        m_stats.startLatency.add(elapsed);
+    else if (m_state == WaitingToStop && (state == Off || state == Paused))
+        m_stats.stopLatency.add(elapsed);
+
+    m_state = state;
+    m_stateEnteredAt = m_stateAccountedAt;
+}
+
+bool Camera::handleLiveViewEvent(LiveView::Event event)
+{
+    const LiveView::Transition * transition = LiveView::findTransition(m_liveView->m_state, event);
+
+    if (! transition) {
+        *s_err << "Live view: ignoring " << LiveView::eventName(event) << " in state " << LiveView::stateName(m_liveView->m_state);
+        pushErrMsg(Debug);
+        return true;
+    }
+
+    *s_err << "Live view: " << LiveView::eventName(event) << " in state " << LiveView::stateName(m_liveView->m_state);
+    pushErrMsg(Debug);
+
+    if (transition->desiredNewState != LiveView::Unchanged)
+        m_liveView->m_desiredNewState = transition->desiredNewState;
+
+    switch (transition->action) {
+        case LiveView::NoAction:
+            return true;
+        case LiveView::RequestStart:
+            return _startLiveView();
+        case LiveView::RequestStop:
+            return _stopLiveView();
+        case LiveView::TurnOff:
+            m_liveView->setState(LiveView::Off);
+            return true;
+        case LiveView::Arrive:
+            return finishLiveViewTransition(false);
+        case LiveView::Recover:
+            return finishLiveViewTransition(true);
+    }
+    assert(false);
+    return false;
+}
+
+bool Camera::finishLiveViewTransition(bool timedOut)
+{
+    bool starting = m_liveView->m_state == LiveView::WaitingToStart;
+
+    // ask the camera what it is actually doing, rather than trusting the
+    // property event parameter
+    EdsUInt32 device;
+    EdsError err = EdsGetPropertyData(m_cam, kEdsPropID_Evf_OutputDevice, 0, sizeof(EdsUInt32), &device);
+    bool streaming;
+    if (err) {
+        *s_err << "Unable to get live view output device: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning);
+        // without an answer, the event is all we have to go on
+        streaming = timedOut ? false : starting;
+    } else {
+        streaming = (device & kEdsEvfOutputDevice_PC) != 0;
+    }
+
+    if (timedOut) {
+        ++m_liveView->m_stats.transitionTimeouts;
+        *s_err << "Live view took too long to " << (starting ? "start" : "stop") << ", camera says it is " << (streaming ? "streaming" : "not streaming");
+        pushErrMsg(Warning);
+    } else if (streaming != starting) {
+        *s_err << "Live view: camera has not finished " << (starting ? "starting" : "stopping") << " yet";
+        pushErrMsg(Debug);
+        return true;
+    }
+
+    if (streaming)
+        m_liveView->setState(LiveView::On);
+    else if (m_liveView->m_desiredNewState == LiveView::Paused)
+        m_liveView->setState(LiveView::Paused);
+    else
+        m_liveView->setState(LiveView::Off);
+
+    // now head for wherever we wanted to be in the meantime
+    switch (m_liveView->m_desiredNewState) {
+        case LiveView::On:
+            return handleLiveViewEvent(LiveView::StartRequested);
+        case LiveView::Off:
+            return handleLiveViewEvent(LiveView::StopRequested);
+        case LiveView::Paused:
+            return handleLiveViewEvent(LiveView::PauseRequested);
+        default:
+            assert(false);
+    }
+    return false;
+}
+
+void Camera::checkLiveViewTimeout()
+{
+    if (m_liveView->m_state != LiveView::WaitingToStart && m_liveView->m_state != LiveView::WaitingToStop)
+        return;
+
+    long long waited = Utils::monotonicMicros() - m_liveView->m_stateEnteredAt;
+    if (waited > c_sleepTimeout * 1000LL)
+        handleLiveViewEvent(LiveView::TimedOut);
+}
+
+void Camera::poll()
+{
+    // first, so that the shutter opens and closes as close to when it
+    // should as we can
+    checkBulb();
+    checkTimelapse();
+    checkLiveViewTimeout();
+    checkBurstTimeout();
+    finishTransfers();
+    checkIngest();
+}
+
+int Camera::pollDelay(int maxDelay) const
+{
+    // the transfer threads are waiting on the listing of a folder, which
+    // goes c_ingestListBatch files per poll. still a short sleep, or the
+    // SDK thread does nothing but poll.
+    if (m_ingest.running && m_ingest.files.empty() && m_ingest.listingFolder)
+        return maxDelay < c_ingestListDelay ? maxDelay : c_ingestListDelay;
+
+    // the soonest thing poll() has to do on time, if anything
+    long long deadline = bulbDeadline();
+    if (m_timelapse.running) {
+        long long shot = timelapseDeadline(m_timelapse.next);
+        if (! deadline || shot < deadline)
+            deadline = shot;
+    }
+    if (! deadline)
+        return maxDelay;
+
+    // round down; waking up a little early only costs another short sleep
+    long long delay = (deadline - Utils::monotonicMicros()) / 1000;
+    if (delay < 0)
+        return 0;
+    if (delay < maxDelay)
+        return (int) delay;
+    return maxDelay;
+}
+
+string Camera::liveViewState() const
+{
+    return LiveView::stateName(m_liveView->m_state);
+}
+
+bool Camera::pauseLiveView()
+{
+    checkLiveViewTimeout();
+    return handleLiveViewEvent(LiveView::PauseRequested);
+}
+
+bool Camera::resumeLiveView()
+{
+    return handleLiveViewEvent(LiveView::ResumeRequested);
+}
+
+bool Camera::setComputerCapabilities()
+{
+    // tell the camera how much disk space we have left
+    EdsCapacity caps;
+
+    caps.reset = true;
+    caps.bytesPerSector = 512;
+    caps.numberOfFreeClusters = 2147483647; // arbitrary large number
+    EdsError err = EdsSetCapacity(m_cam, caps);
+
+    if (err) {
+        *s_err << "Unable to set computer capabilities: " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+        return false;
+    }
+
+    return true;
+}
+
+bool Camera::keepLiveViewForCapture() const
+{
+    if (m_captureLiveViewMode != KeepLiveView)
+        return false;
+
+    if (m_liveView->m_state != LiveView::On)
+        return false;
+
+    if (! m_cameraData || ! m_cameraData->liveViewSurvivesCapture) {
+        *s_err << "This camera can't keep live view on while taking a picture, restarting it instead.";
+        pushErrMsg(Warning);
+        return false;
+    }
+
+    return true;
+}
+
+void Camera::endExposure()
+{
+    if (! m_liveView->m_exposing)
+        return;
+
+    *s_err << "Exposure finished, resuming live view frame grabs.";
+    pushErrMsg(Debug);
+    m_liveView->m_exposing = false;
+}
+
+void Camera::setCaptureLiveViewMode(CaptureLiveViewMode mode)
+{
+    m_captureLiveViewMode = mode;
+}
+
+Camera::CaptureLiveViewMode Camera::captureLiveViewMode() const
+{
+    return m_captureLiveViewMode;
+}
+
+bool Camera::takeSinglePicture(string outFile)
+{
+    return takePicture(outFile, false);
+}
+
+bool Camera::takeSinglePictureToMemory()
+{
+    return takePicture(string(), true);
+}
+
+bool Camera::takePicture(string outFile, bool toMemory)
+{
+    if (m_burst.shutterHeld) {
+        *s_err << "Unable to take picture, a burst is still being shot";
+        pushErrMsg(Warning);
+        return false;
+    }
+    if (m_bulb.exposing) {
+        *s_err << "Unable to take picture, the shutter is open for a bulb exposure";
+        pushErrMsg(Warning);
+        return false;
+    }
+    // TakePicture focuses for itself, which it can't do with the button
+    // already held halfway
+    if (m_focusHeld) {
+        *s_err << "Letting go of the half pressed shutter button to take a picture";
+        pushErrMsg(Debug);
+        releaseFocus();
+    }
+
+    if (! beginShot(outFile, toMemory))
+        return false;
+
+    *s_err << "Sending take picture command.";
+    pushErrMsg(Debug);
+    m_lastShutterTime = Utils::monotonicMicros();
+    // take a picture with the camera and save it to outfile
+    EdsError err = EdsSendCommand(m_cam, kEdsCameraCommand_TakePicture, 0);
+    long long returned = Utils::monotonicMicros();
+
+    if (err == EDS_ERR_OBJECT_NOTREADY) {
+        *s_err << "unable to take picture, camera not ready";
+        pushErrMsg(Warning);
+        abandonShot();
+        return false;
+    } else if (err) {
+        *s_err << "unable to take picture: " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+        abandonShot();
+        return false;
+    }
+
+    m_shutterLagStats.takePictureCommand.add(returned - m_lastShutterTime);
+    m_lagShutterTime = m_lastShutterTime;
+    m_lagPrefocused = false;
+
+    return true;
+}
+
+bool Camera::prefocus()
+{
+    if (m_burst.shutterHeld) {
+        *s_err << "Unable to prefocus, a burst is still being shot";
+        pushErrMsg(Warning);
+        return false;
+    }
+    if (m_bulb.exposing) {
+        *s_err << "Unable to prefocus, the shutter is open for a bulb exposure";
+        pushErrMsg(Warning);
+        return false;
+    }
+
+    // pressing it halfway again doesn't focus again unless it was let go
+    releaseFocus();
+
+    *s_err << "Holding the shutter button halfway";
+    pushErrMsg(Debug);
+    long long sent = Utils::monotonicMicros();
+    EdsError err = EdsSendCommand(m_cam, kEdsCameraCommand_PressShutterButton, kEdsCameraCommand_ShutterButton_Halfway);
+    long long returned = Utils::monotonicMicros();
+
+    if (err) {
+        *s_err << "Unable to press the shutter button halfway: " << ErrorMap::errorMsg(err);
+        pushErrMsg(err == EDS_ERR_OBJECT_NOTREADY ? Warning : Error);
+        return false;
+    }
+
+    m_focusHeld = true;
+    m_shutterLagStats.prefocusCommand.add(returned - sent);
+
+    return true;
+}
+
+bool Camera::takePrefocusedPicture(string outFile, bool keepHolding)
+{
+    if (! m_focusHeld) {
+        *s_err << "Unable to take a prefocused picture, the shutter button isn't held halfway";
+        pushErrMsg(Warning);
+        return false;
+    }
+
+    if (! beginShot(outFile, false))
+        return false;
+
+    *s_err << "Pressing the shutter button the rest of the way";
+    pushErrMsg(Debug);
+    m_lastShutterTime = Utils::monotonicMicros();
+    // NonAF, so that the focus from the half press is the one used
+    EdsError err = EdsSendCommand(m_cam, kEdsCameraCommand_PressShutterButton, kEdsCameraCommand_ShutterButton_Completely_NonAF);
+    long long returned = Utils::monotonicMicros();
+
+    if (err) {
+        // still held halfway, so it can be tried again
+        *s_err << "Unable to press the shutter button: " << ErrorMap::errorMsg(err);
+        pushErrMsg(err == EDS_ERR_OBJECT_NOTREADY ? Warning : Error);
+        abandonShot();
+        return false;
+    }
+
+    m_shutterLagStats.prefocusedCommand.add(returned - m_lastShutterTime);
+    m_lagShutterTime = m_lastShutterTime;
+    m_lagPrefocused = true;
+
+    // back up to halfway without focusing again, or all the way up
+    err = EdsSendCommand(m_cam, kEdsCameraCommand_PressShutterButton,
+        keepHolding ? kEdsCameraCommand_ShutterButton_Halfway_NonAF : kEdsCameraCommand_ShutterButton_OFF);
+    if (err) {
+        *s_err << "Unable to let the shutter button back up: " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+        if (keepHolding)
+            EdsSendCommand(m_cam, kEdsCameraCommand_PressShutterButton, kEdsCameraCommand_ShutterButton_OFF);
+    }
+    m_focusHeld = keepHolding && ! err;
+
+    return true;
+}
+
+void Camera::releaseFocus()
+{
+    if (! m_focusHeld)
+        return;
+
+    EdsError err = EdsSendCommand(m_cam, kEdsCameraCommand_PressShutterButton, kEdsCameraCommand_ShutterButton_OFF);
+    if (err) {
+        *s_err << "Unable to let go of the shutter button: " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+    }
+    m_focusHeld = false;
+}
+
+bool Camera::focusHeld() const
+{
+    return m_focusHeld;
+}
+
+void Camera::shutterLagPictureArrived(long long now)
+{
+    if (m_lagShutterTime == 0)
+        return;
+
+    if (m_lagPrefocused)
+        m_shutterLagStats.prefocusedToRequest.add(now - m_lagShutterTime);
+    else
+        m_shutterLagStats.takePictureToRequest.add(now - m_lagShutterTime);
+    m_lagShutterTime = 0;
+}
+
+Camera::ShutterLagStats Camera::shutterLagStats() const
+{
+    return m_shutterLagStats;
+}
+
+void Camera::resetShutterLagStats()
+{
+    m_shutterLagStats = ShutterLagStats();
+}
+
+bool Camera::beginShot(string outFile, bool toMemory)
+{
+    if (keepLiveViewForCapture()) {
+        // live view keeps streaming; we just stay out of the camera's way
+        // until the exposure is done.
+        m_liveView->m_exposing = true;
+    } else if (! pauseLiveView()) {
+        return false;
+    }
+
+    if (! setComputerCapabilities()) {
+        endExposure();
+        return false;
+    }
+
+    // queue up where the picture goes before the camera can possibly
+    // hand it to us
+    ShotDestination shot;
+    shot.outFile = outFile;
+    shot.toMemory = toMemory;
+    shot.frames = 0;
+    DriveMode mode = driveMode();
+    shot.multipleFrames = mode == ContinuousShooting || mode == HighSpeedContinuousShooting
+        || mode == LowSpeedContinuousShooting || mode == TenSecSelfTimerPlusShots;
+    m_shotDestinations.push_back(shot);
+
+    return true;
+}
+
+void Camera::abandonShot()
+{
+    m_shotDestinations.pop_back();
+    endExposure();
+}
+
+bool Camera::takeBurst(int count, string nameTemplate, DriveMode mode)
+{
+    if (count < 1) {
+        *s_err << "Unable to take a burst of " << count << " pictures";
+        pushErrMsg(Warning);
+        return false;
+    }
+
+    if (m_burst.shutterHeld) {
+        *s_err << "Unable to take burst, the last one is still being shot";
+        pushErrMsg(Warning);
+        return false;
+    }
+    if (m_bulb.exposing) {
+        *s_err << "Unable to take burst, the shutter is open for a bulb exposure";
+        pushErrMsg(Warning);
+        return false;
+    }
+    releaseFocus();
+
+    // every frame needs a name of its own
+    nameTemplate = addFrameNumber(nameTemplate);
+
+    m_burst.previousDriveMode = driveMode();
+    // holding the shutter down in some other mode isn't the burst that
+    // was asked for
+    if (mode != m_burst.previousDriveMode && ! setDriveMode(mode)) {
+        *s_err << "Unable to take burst, the camera wouldn't switch drive modes";
+        pushErrMsg(Warning);
+        return false;
+    }
+
+    if (! beginShot(nameTemplate, false)) {
+        setDriveMode(m_burst.previousDriveMode);
+        return false;
+    }
+
+    // the burst's frames aren't timed against the last single shot
+    m_lagShutterTime = 0;
+    m_burst.report = BurstReport();
+    m_burst.report.requested = count;
+    m_burst.report.pressTime = Utils::monotonicMicros();
+    m_burst.lastFrameTime = m_burst.report.pressTime;
+
+    *s_err << "Holding the shutter button down for a burst of " << count;
+    pushErrMsg(Debug);
+    // hold the shutter button down until we have all the frames
+    EdsError err = EdsSendCommand(m_cam, kEdsCameraCommand_PressShutterButton, kEdsCameraCommand_ShutterButton_Completely);
+
+    if (err) {
+        *s_err << "unable to press the shutter button: " << ErrorMap::errorMsg(err);
+        pushErrMsg(err == EDS_ERR_OBJECT_NOTREADY ? Warning : Error);
+        abandonShot();
+        setDriveMode(m_burst.previousDriveMode);
+        return false;
+    }
+
+    m_burst.shutterHeld = true;
+    m_burst.recording = true;
+
+    return true;
+}
+
+void Camera::burstFrameArrived(int transfer, long long captureTime)
+{
+    BurstFrame frame;
+    frame.frame = m_burst.report.frames.size() + 1;
+    frame.transfer = transfer;
+    frame.captureTime = captureTime;
+    frame.transferTime = 0;
+    m_burst.report.frames.push_back(frame);
+    m_burst.lastFrameTime = captureTime;
+
+    // the camera may still have a few more frames in its buffer after we
+    // let go. they get counted as well.
+    if (m_burst.shutterHeld && (int) m_burst.report.frames.size() >= m_burst.report.requested)
+        releaseBurst();
+}
+
+void Camera::burstFrameTransferred(int transfer, long long transferTime, const string & filename)
+{
+    vector<BurstFrame> & frames = m_burst.report.frames;
+    for (unsigned int i = 0; i < frames.size(); i++) {
+        if (frames[i].transfer == transfer) {
+            frames[i].transferTime = transferTime;
+            frames[i].filename = filename;
+            return;
+        }
+    }
+}
+
+void Camera::releaseBurst()
+{
+    if (! m_burst.shutterHeld)
+        return;
+
+    EdsError err = EdsSendCommand(m_cam, kEdsCameraCommand_PressShutterButton, kEdsCameraCommand_ShutterButton_OFF);
+    if (err) {
+        *s_err << "Unable to let go of the shutter button: " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+    }
+
+    m_burst.shutterHeld = false;
+    m_burst.report.releaseTime = Utils::monotonicMicros();
+
+    if (driveMode() != m_burst.previousDriveMode)
+        setDriveMode(m_burst.previousDriveMode);
+
+    endExposure();
+}
+
+void Camera::checkBurstTimeout()
+{
+    if (! m_burst.shutterHeld)
+        return;
+
+    if (Utils::monotonicMicros() - m_burst.lastFrameTime < (long long) c_sleepTimeout * 1000)
+        return;
+
+    *s_err << "Camera stopped sending burst frames after " << m_burst.report.frames.size() << " of " << m_burst.report.requested;
+    pushErrMsg(Warning);
+    releaseBurst();
+}
+
+bool Camera::burstInProgress() const
+{
+    return m_burst.shutterHeld;
+}
+
+Camera::BurstReport Camera::lastBurst() const
+{
+    BurstReport report = m_burst.report;
+    const vector<BurstFrame> & frames = report.frames;
+
+    report.captureFps = 0;
+    if (frames.size() > 1) {
+        long long span = frames.back().captureTime - frames.front().captureTime;
+        if (span > 0)
+            report.captureFps = (frames.size() - 1) * 1000000.0 / span;
+    }
+
+    // from pressing the button to the last saved frame, which is what
+    // you can keep up
+    report.transferFps = 0;
+    int transferred = 0;
+    long long lastTransfer = 0;
+    for (unsigned int i = 0; i < frames.size(); i++) {
+        if (frames[i].transferTime) {
+            ++transferred;
+            if (frames[i].transferTime > lastTransfer)
+                lastTransfer = frames[i].transferTime;
+        }
+    }
+    if (transferred > 0 && lastTransfer > report.pressTime)
+        report.transferFps = transferred * 1000000.0 / (lastTransfer - report.pressTime);
+
+    return report;
+}
+
+bool Camera::nextPictureDestination(string & outFile, bool & toMemory)
+{
+    // a new shot, or another frame of the last one
+    bool newShot = false;
+    if (! m_shotDestinations.empty()) {
+        m_currentShot = m_shotDestinations.front();
+        m_shotDestinations.pop_front();
+        m_haveCurrentShot = true;
+        newShot = true;
+    }
+
+    if (! m_haveCurrentShot) {
+        // somebody pressed the shutter on the camera itself. keep the
+        // picture in memory so that it isn't lost.
+        *s_err << "Got a picture we didn't take, keeping it in memory";
+        pushErrMsg(Warning);
+        outFile = string();
+        toMemory = true;
+        return false;
+    }
+
+    ++m_currentShot.frames;
+    outFile = expandNameTemplate(m_currentShot.outFile, m_currentShot.frames);
+    toMemory = m_currentShot.toMemory;
+    // nothing more is coming for it, so the next picture that isn't
+    // ours doesn't get its name
+    if (! m_currentShot.multipleFrames)
+        m_haveCurrentShot = false;
+    return newShot;
+}
+
+string Camera::expandNameTemplate(string nameTemplate, int frame)
+{
+    size_t pos = nameTemplate.find("%n");
+    if (pos == string::npos)
+        return nameTemplate;
+
+    return nameTemplate.replace(pos, 2, Utils::intToString(frame));
+}
+
+string Camera::addFrameNumber(string nameTemplate)
+{
+    if (nameTemplate.find("%n") != string::npos)
+        return nameTemplate;
+
+    string ext = getExtension(nameTemplate);
+    return nameTemplate.substr(0, nameTemplate.length() - ext.length()) + "_%n" + ext;
+}
+
+bool Camera::startTimelapse(int intervalMs, int count, string nameTemplate, TimelapseBusyPolicy policy)
+{
+    if (intervalMs < 1 || count < 0) {
+        *s_err << "Unable to start a timelapse of " << count << " shots every " << intervalMs << " ms";
+        pushErrMsg(Warning);
+        return false;
+    }
+
+    if (m_timelapse.running) {
+        *s_err << "Unable to start timelapse, one is already running";
+        pushErrMsg(Warning);
+        return false;
+    }
+
+    m_timelapse.nameTemplate = addFrameNumber(nameTemplate);
+    m_timelapse.policy = policy;
+    m_timelapse.next = 0;
+    m_timelapse.report = TimelapseReport();
+    m_timelapse.report.interval = intervalMs * 1000LL;
+    m_timelapse.report.requested = count;
+    m_timelapse.report.startTime = Utils::monotonicMicros();
+    m_timelapse.running = true;
+
+    // the first shot is due right away
+    checkTimelapse();
+
+    return true;
+}
+
+void Camera::stopTimelapse()
+{
+    m_timelapse.running = false;
+}
+
+bool Camera::timelapseRunning() const
+{
+    return m_timelapse.running;
+}
+
+Camera::TimelapseReport Camera::timelapseReport() const
+{
+    return m_timelapse.report;
+}
+
+const char * Camera::timelapseShotStatusName(TimelapseShotStatus status)
+{
+    switch (status) {
+        case ShotTaken: return "Taken";
+        case ShotFailed: return "Failed";
+        case ShotSkippedBusy: return "SkippedBusy";
+        case ShotMissed: return "Missed";
+    }
+    return "Unknown";
+}
+
+long long Camera::timelapseDeadline(int index) const
+{
+    // always from the start, so that lateness doesn't add up
+    return m_timelapse.report.startTime + index * m_timelapse.report.interval;
+}
+
+bool Camera::captureInFlight() const
+{
+    return m_burst.shutterHeld || ! m_shotDestinations.empty() || m_transfersInFlight > 0 || ! m_pendingFrames.empty();
+}
+
+void Camera::checkTimelapse()
+{
+    if (! m_timelapse.running)
+        return;
+
+    TimelapseReport & report = m_timelapse.report;
+    long long now = Utils::monotonicMicros();
+    if (now < timelapseDeadline(m_timelapse.next))
+        return;
+
+    // if we slept through whole intervals, those shots are gone. taking
+    // them now would just be a burst of late pictures.
+    while (now >= timelapseDeadline(m_timelapse.next + 1)
+        && (report.requested == 0 || m_timelapse.next + 1 < report.requested))
+    {
+        TimelapseShot shot;
+        shot.shot = m_timelapse.next + 1;
+        shot.status = ShotMissed;
+        shot.deadline = timelapseDeadline(m_timelapse.next);
+        shot.fireTime = 0;
+        shot.jitter = 0;
+        shot.overlapped = false;
+        recordTimelapseShot(shot);
+        ++m_timelapse.next;
+    }
+
+    TimelapseShot shot;
+    shot.shot = m_timelapse.next + 1;
+    shot.deadline = timelapseDeadline(m_timelapse.next);
+    shot.fireTime = 0;
+    shot.jitter = 0;
+    shot.overlapped = captureInFlight();
+    ++m_timelapse.next;
+
+    if (shot.overlapped && m_timelapse.policy == SkipWhenBusy) {
+        *s_err << "Skipping timelapse shot " << shot.shot << ", the last picture isn't done yet";
+        pushErrMsg(Warning);
+        shot.status = ShotSkippedBusy;
+        shot.overlapped = false;
+    } else {
+        shot.filename = expandNameTemplate(m_timelapse.nameTemplate, shot.shot);
+        bool taken = takeSinglePicture(shot.filename);
+        shot.status = taken ? ShotTaken : ShotFailed;
+        if (taken) {
+            shot.fireTime = m_lastShutterTime;
+            shot.jitter = shot.fireTime - shot.deadline;
+        }
+    }
+    recordTimelapseShot(shot);
+
+    if (report.requested != 0 && m_timelapse.next >= report.requested) {
+        *s_err << "Timelapse finished: " << report.taken << " of " << report.requested << " shots taken";
+        pushErrMsg(Debug);
+        m_timelapse.running = false;
+    }
+}
+
+void Camera::recordTimelapseShot(TimelapseShot & shot)
+{
+    TimelapseReport & report = m_timelapse.report;
+    switch (shot.status) {
+        case ShotTaken:
+            ++report.taken;
+            report.jitter.add(shot.jitter);
+            break;
+        case ShotFailed: ++report.failed; break;
+        case ShotSkippedBusy: ++report.skippedBusy; break;
+        case ShotMissed: ++report.missed; break;
+    }
+    if (shot.overlapped)
+        ++report.overlapped;
+    report.shots.push_back(shot);
+    // a timelapse can go on for days, and the report is copied whenever
+    // it is asked for
+    while ((int) report.shots.size() > c_maxReportedShots)
+        report.shots.pop_front();
+}
+
+bool Camera::takeBulbExposure(int durationMs, string outFile)
+{
+    return queueBulbExposures(1, durationMs, 0, outFile, false);
+}
+
+bool Camera::takeBulbSequence(int count, int durationMs, int gapMs, string nameTemplate)
+{
+    return queueBulbExposures(count, durationMs, gapMs, nameTemplate, true);
+}
+
+bool Camera::queueBulbExposures(int count, int durationMs, int gapMs, string outFile, bool numbered)
+{
+    if (count < 1 || durationMs < 1 || gapMs < 0) {
+        *s_err << "Unable to take " << count << " bulb exposures of " << durationMs << " ms, " << gapMs << " ms apart";
+        pushErrMsg(Warning);
+        return false;
+    }
+
+    // a new report, unless these are going on the end of a sequence
+    if (! bulbInProgress()) {
+        m_bulb.report = BulbReport();
+        m_bulb.nextStart = Utils::monotonicMicros();
+        m_bulb.busySince = 0;
+    }
+
+    if (numbered)
+        outFile = addFrameNumber(outFile);
+    int first = m_bulb.report.requested + 1;
+    for (int i = 0; i < count; i++) {
+        BulbJob job;
+        job.duration = durationMs * 1000LL;
+        job.gap = gapMs * 1000LL;
+        job.outFile = numbered ? expandNameTemplate(outFile, first + i) : outFile;
+        m_bulb.queue.push_back(job);
+    }
+    m_bulb.report.requested += count;
+
+    // the first one may be due right away
+    checkBulb();
+
+    return true;
+}
+
+void Camera::cancelBulb()
+{
+    if (m_bulb.exposing)
+        endBulb(false);
+
+    for (unsigned int i = 0; i < m_bulb.queue.size(); i++) {
+        BulbExposure exposure;
+        exposure.exposure = m_bulb.report.taken + m_bulb.report.failed + 1;
+        exposure.success = false;
+        exposure.requested = m_bulb.queue[i].duration;
+        exposure.startSent = exposure.startReturned = exposure.endSent = exposure.endReturned = 0;
+        exposure.achieved = exposure.error = exposure.uncertainty = 0;
+        exposure.filename = m_bulb.queue[i].outFile;
+        recordBulbExposure(exposure);
+    }
+    m_bulb.queue.clear();
+}
+
+bool Camera::bulbInProgress() const
+{
+    return m_bulb.exposing || ! m_bulb.queue.empty();
+}
+
+Camera::BulbReport Camera::bulbReport() const
+{
+    return m_bulb.report;
+}
+
+long long Camera::bulbDeadline() const
+{
+    if (m_bulb.exposing)
+        return m_bulb.endAt - c_bulbSpin;
+    if (! m_bulb.queue.empty())
+        return m_bulb.nextStart;
+    return 0;
+}
+
+void Camera::checkBulb()
+{
+    if (m_bulb.exposing) {
+        if (Utils::monotonicMicros() >= m_bulb.endAt)
+            endBulb();
+        return;
+    }
+
+    if (! m_bulb.queue.empty() && Utils::monotonicMicros() >= m_bulb.nextStart)
+        startBulb();
+}
+
+void Camera::startBulb()
+{
+    BulbJob job = m_bulb.queue.front();
+    long long now = Utils::monotonicMicros();
+
+    BulbExposure exposure;
+    exposure.exposure = m_bulb.report.taken + m_bulb.report.failed + 1;
+    exposure.success = false;
+    exposure.requested = job.duration;
+    exposure.startSent = exposure.startReturned = exposure.endSent = exposure.endReturned = 0;
+    exposure.achieved = exposure.error = exposure.uncertainty = 0;
+    exposure.filename = job.outFile;
+
+    EdsError err = EDS_ERR_OK;
+    bool busy = m_burst.shutterHeld;
+    if (! busy)
+        releaseFocus();
+    // beginShot() says why if it fails
+    bool shotBegun = ! busy && beginShot(job.outFile, false);
+    if (! busy && ! shotBegun) {
+        // live view wouldn't get out of the way, or the like, which can
+        // pass like a busy camera does
+        // it is asked again every c_bulbRetry, so only the first time is
+        // worth a warning
+        *s_err << "Unable to get ready for bulb exposure " << exposure.exposure;
+        pushErrMsg(m_bulb.busySince ? Debug : Warning);
+        busy = true;
+    }
+    if (shotBegun) {
+        // its picture isn't timed against the last single shot
+        m_lagShutterTime = 0;
+        // the SDK wants the camera's own controls locked while the bulb
+        // commands are in charge of the shutter
+        EdsSendStatusCommand(m_cam, kEdsCameraStatusCommand_UILock, 0);
+
+        exposure.startSent = Utils::monotonicMicros();
+        if (! m_bulb.useShutterButton) {
+            err = EdsSendCommand(m_cam, kEdsCameraCommand_BulbStart, 0);
+            if (err == EDS_ERR_NOT_SUPPORTED) {
+                *s_err << "The camera doesn't do BulbStart, holding the shutter button instead";
+                pushErrMsg(Debug);
+                m_bulb.useShutterButton = true;
+                exposure.startSent = Utils::monotonicMicros();
+            }
+        }
+        if (m_bulb.useShutterButton)
+            err = EdsSendCommand(m_cam, kEdsCameraCommand_PressShutterButton, kEdsCameraCommand_ShutterButton_Completely_NonAF);
+        exposure.startReturned = Utils::monotonicMicros();
+
+        if (err == EDS_ERR_OK) {
+            // if the close command takes as long to get through as the open
+            // one did, sending it exactly the duration after the open went
+            // out puts the middles of the two the duration apart
+            m_bulb.current = exposure;
+            m_bulb.endAt = exposure.startSent + job.duration;
+            m_bulb.exposing = true;
+            m_bulb.busySince = 0;
+            m_bulb.closeAttempts = 0;
+            return;
+        }
+
+        EdsSendStatusCommand(m_cam, kEdsCameraStatusCommand_UIUnLock, 0);
+        abandonShot();
+        busy = err == EDS_ERR_DEVICE_BUSY || err == EDS_ERR_OBJECT_NOTREADY;
+    }
+
+    // still busy with the last picture, or writing a dark frame for it,
+    // which takes as long as the exposure did. ask again in a bit.
+    if (busy) {
+        if (! m_bulb.busySince)
+            m_bulb.busySince = now;
+        long long patience = c_sleepTimeout * 1000LL + job.duration;
+        if (now - m_bulb.busySince < patience) {
+            m_bulb.nextStart = now + c_bulbRetry;
+            return;
+        }
+        *s_err << "Gave up on bulb exposure " << exposure.exposure << ", the camera never got ready for it";
+        pushErrMsg();
+    } else if (shotBegun) {
+        *s_err << "Unable to start bulb exposure " << exposure.exposure << ": " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+    }
+
+    recordBulbExposure(exposure);
+    m_bulb.queue.pop_front();
+    m_bulb.nextStart = now + job.gap;
+    m_bulb.busySince = 0;
+}
+
+void Camera::endBulb(bool retry)
+{
+    BulbExposure & exposure = m_bulb.current;
+
+    exposure.endSent = Utils::monotonicMicros();
+    EdsError err;
+    if (m_bulb.useShutterButton)
+        err = EdsSendCommand(m_cam, kEdsCameraCommand_PressShutterButton, kEdsCameraCommand_ShutterButton_OFF);
+    else
+        err = EdsSendCommand(m_cam, kEdsCameraCommand_BulbEnd, 0);
+    // once BulbEnd has failed, letting go of the shutter button may still
+    // get through to the camera
+    if (err && ! m_bulb.useShutterButton && (m_bulb.closeAttempts > 0 || ! retry))
+        err = EdsSendCommand(m_cam, kEdsCameraCommand_PressShutterButton, kEdsCameraCommand_ShutterButton_OFF);
+    exposure.endReturned = Utils::monotonicMicros();
+
+    if (err) {
+        ++m_bulb.closeAttempts;
+        if (retry && m_bulb.closeAttempts < c_bulbCloseAttempts) {
+            *s_err << "Unable to end bulb exposure " << exposure.exposure << ", trying again: " << ErrorMap::errorMsg(err);
+            pushErrMsg(Warning);
+            // the shutter may well still be open, so checkBulb() comes
+            // back here
+            m_bulb.endAt = exposure.endReturned + c_bulbRetry;
+            return;
+        }
+    }
+
+    EdsSendStatusCommand(m_cam, kEdsCameraStatusCommand_UIUnLock, 0);
+    m_bulb.exposing = false;
+
+    if (err) {
+        *s_err << "Unable to end bulb exposure " << exposure.exposure << " after " << m_bulb.closeAttempts
+            << " tries: " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+        // no picture is coming for it, and its destination mustn't be
+        // handed to the next one that does
+        abandonShot();
+    } else {
+        exposure.success = true;
+        exposure.achieved = ((exposure.endSent + exposure.endReturned) - (exposure.startSent + exposure.startReturned)) / 2;
+        exposure.error = exposure.achieved - exposure.requested;
+        long long startTrip = exposure.startReturned - exposure.startSent;
+        long long endTrip = exposure.endReturned - exposure.endSent;
+        exposure.uncertainty = (startTrip > endTrip ? startTrip : endTrip) / 2;
+
+        *s_err << "Bulb exposure " << exposure.exposure << ": " << exposure.achieved << " us, "
+            << exposure.error << " us off, give or take " << exposure.uncertainty;
+        pushErrMsg(Debug);
+    }
+
+    recordBulbExposure(exposure);
+    m_bulb.nextStart = exposure.endReturned + m_bulb.queue.front().gap;
+    m_bulb.queue.pop_front();
+}
+
+void Camera::recordBulbExposure(BulbExposure & exposure)
+{
+    BulbReport & report = m_bulb.report;
+    if (exposure.success) {
+        ++report.taken;
+        report.absoluteError.add(exposure.error < 0 ? -exposure.error : exposure.error);
+    } else {
+        ++report.failed;
+    }
+    report.exposures.push_back(exposure);
+    while ((int) report.exposures.size() > c_maxReportedShots)
+        report.exposures.pop_front();
+}
+
+bool Camera::startIngest(string folder, int maxInFlight)
+{
+    if (m_ingest.running) {
+        *s_err << "An ingest is already running";
+        pushErrMsg(Warning);
+        return false;
+    }
+
+    m_manifest.close();
+    return beginIngest(folder, maxInFlight, false, false);
+}
+
+bool Camera::startSync(string folder, int maxInFlight, bool fullScan)
+{
+    if (m_ingest.running) {
+        *s_err << "An ingest is already running";
+        pushErrMsg(Warning);
+        return false;
+    }
+    if (! transferThreadsStarted()) {
+        *s_err << "Can't sync without a connection to the camera";
+        pushErrMsg();
+        return false;
+    }
+
+    string body = bodyID();
+    if (body.empty()) {
+        *s_err << "Can't sync without the camera's serial number";
+        pushErrMsg();
+        return false;
+    }
+
+    ensurePathExists(folder);
+    if (! m_manifest.open(pathCombine(folder, "manifest-" + body + ".txt"))) {
+        *s_err << m_manifest.error();
+        pushErrMsg();
+        return false;
+    }
+
+    *s_err << "Syncing against " << m_manifest.path() << ", which has " << m_manifest.size() << " files";
+    pushErrMsg(Debug);
+
+    if (beginIngest(folder, maxInFlight, true, fullScan))
+        return true;
+    m_manifest.close();
+    return false;
+}
+
+bool Camera::beginIngest(string folder, int maxInFlight, bool sync, bool fullScan)
+{
+    if (! transferThreadsStarted()) {
+        *s_err << "Can't ingest without a connection to the camera";
+        pushErrMsg();
+        return false;
+    }
+
+    // the volumes are the cards. only the DCIM folder has pictures in it,
+    // the rest is print orders and the like.
+    EdsUInt32 volumeCount = 0;
+    EdsError err = EdsGetChildCount(m_cam, &volumeCount);
+    if (err) {
+        *s_err << "Unable to count the camera's cards: " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+        return false;
+    }
+
+    for (EdsUInt32 i = 0; i < volumeCount; i++) {
+        EdsVolumeRef volume = NULL;
+        err = EdsGetChildAtIndex(m_cam, i, &volume);
+        if (err) {
+            *s_err << "Unable to get card " << i << ": " << ErrorMap::errorMsg(err);
+            pushErrMsg(Warning);
+            continue;
+        }
+
+        EdsVolumeInfo volumeInfo;
+        err = EdsGetVolumeInfo(volume, &volumeInfo);
+        if (err || volumeInfo.storageType == kEdsStorageType_Non) {
+            EdsRelease(volume);
+            continue;
+        }
+
+        EdsUInt32 childCount = 0;
+        EdsGetChildCount(volume, &childCount);
+        for (EdsUInt32 j = 0; j < childCount; j++) {
+            EdsDirectoryItemRef child = NULL;
+            if (EdsGetChildAtIndex(volume, j, &child))
+                continue;
+            EdsDirectoryItemInfo info;
+            if (EdsGetDirectoryItemInfo(child, &info) == EDS_ERR_OK && info.isFolder
+                && string(info.szFileName) == "DCIM")
+            {
+                IngestItem item;
+                item.ref = child;
+                item.name = info.szFileName;
+                item.path = info.szFileName;
+                item.size = 0;
+                m_ingest.folders.push_back(item);
+            } else {
+                EdsRelease(child);
+            }
+        }
+        EdsRelease(volume);
+    }
+
+    if (m_ingest.folders.empty()) {
+        *s_err << "No pictures on the camera's cards";
+        pushErrMsg(Warning);
+        return false;
+    }
+
+    m_ingest.folder = folder;
+    m_ingest.maxInFlight = maxInFlight < 1 ? 1 : maxInFlight;
+    m_ingest.sync = sync;
+    m_ingest.fullScan = fullScan;
+    m_ingest.report = IngestReport();
+    m_ingest.report.running = true;
+    m_ingest.report.startTime = Utils::monotonicMicros();
+    m_ingest.running = true;
+
+    checkIngest();
+
+    return true;
+}
+
+void Camera::stopIngest()
+{
+    // whatever isn't with the transfer threads yet is dropped
+    for (unsigned int i = 0; i < m_ingest.folders.size(); i++)
+        EdsRelease(m_ingest.folders[i].ref);
+    m_ingest.folders.clear();
+    if (m_ingest.listingFolder) {
+        EdsRelease(m_ingest.listing.ref);
+        m_ingest.listingFolder = false;
+    }
+    for (unsigned int i = 0; i < m_ingest.listedFiles.size(); i++)
+        EdsRelease(m_ingest.listedFiles[i].ref);
+    m_ingest.listedFiles.clear();
+    for (unsigned int i = 0; i < m_ingest.listedFolders.size(); i++)
+        EdsRelease(m_ingest.listedFolders[i].ref);
+    m_ingest.listedFolders.clear();
+    for (unsigned int i = 0; i < m_ingest.files.size(); i++)
+        EdsRelease(m_ingest.files[i].ref);
+    m_ingest.files.clear();
+
+    finishIngestIfDone();
+}
+
+bool Camera::ingestRunning() const
+{
+    return m_ingest.running;
+}
+
+Camera::IngestReport Camera::ingestReport() const
+{
+    IngestReport report = m_ingest.report;
+    long long end = report.endTime ? report.endTime : Utils::monotonicMicros();
+    if (report.startTime && end > report.startTime)
+        report.megabytesPerSecond = report.bytesCopied / (1024.0 * 1024.0) / ((end - report.startTime) / 1000000.0);
+    return report;
+}
+
+bool Camera::popIngestedFile(CompletedPicture & file)
+{
+    Lock lock(m_pictureDoneMutex);
+    if (m_ingestedFiles.empty())
+        return false;
+
+    file.swap(m_ingestedFiles.front());
+    m_ingestedFiles.pop_front();
+    return true;
+}
+
+void Camera::checkIngest()
+{
+    if (! m_ingest.running)
+        return;
+
+    // keep the next folder listed before the transfer threads run out of
+    // this one
+    if (m_ingest.files.size() < (unsigned int) m_ingest.maxInFlight * 2)
+        listIngestFolder();
+
+    while ((int) m_ingest.inFlight.size() < m_ingest.maxInFlight && ! m_ingest.files.empty()) {
+        queueIngestFile(m_ingest.files.front());
+        m_ingest.files.pop_front();
+    }
+
+    finishIngestIfDone();
+}
+
+void Camera::listIngestFolder()
+{
+    EdsError err;
+    if (! m_ingest.listingFolder) {
+        if (m_ingest.folders.empty())
+            return;
+        m_ingest.listing = m_ingest.folders.front();
+        m_ingest.listingFolder = true;
+        m_ingest.folders.pop_front();
+        m_ingest.listCount = 0;
+        m_ingest.listNext = 0;
+
+        err = EdsGetChildCount(m_ingest.listing.ref, &m_ingest.listCount);
+        if (err) {
+            *s_err << "Unable to list " << m_ingest.listing.path << " on the card: " << ErrorMap::errorMsg(err);
+            pushErrMsg(Warning);
+            EdsRelease(m_ingest.listing.ref);
+            m_ingest.listingFolder = false;
+            return;
+        }
+    }
+
+    // a quick sync starts from the newest end of the folder, and stops at
+    // the first file it already has, so it only looks at what is new
+    bool backwards = m_ingest.sync && ! m_ingest.fullScan;
+
+    // a few at a time, so that poll() doesn't stall on a folder of
+    // thousands of pictures
+    for (int i = 0; i < c_ingestListBatch && m_ingest.listNext < m_ingest.listCount; i++) {
+        EdsUInt32 index = m_ingest.listNext++;
+        if (backwards)
+            index = m_ingest.listCount - 1 - index;
+
+        bool readCard = false;
+        EdsDirectoryItemRef child = NULL;
+        err = EdsGetChildAtIndex(m_ingest.listing.ref, index, &child);
+        if (err) {
+            *s_err << "Unable to get an item on the card: " << ErrorMap::errorMsg(err);
+            pushErrMsg(Warning);
+            continue;
+        }
+
+        EdsDirectoryItemInfo info;
+        err = EdsGetDirectoryItemInfo(child, &info);
+        if (err) {
+            *s_err << "Unable to get directory item info: " << ErrorMap::errorMsg(err);
+            pushErrMsg(Warning);
+            EdsRelease(child);
+            continue;
+        }
+
+        IngestItem item;
+        item.ref = child;
+        item.name = info.szFileName;
+        item.path = m_ingest.listing.path + "/" + item.name;
+        item.size = info.size;
+        if (info.isFolder) {
+            m_ingest.listedFolders.push_back(item);
+        } else if (m_ingest.sync && alreadySynced(item, readCard)) {
+            ++m_ingest.report.alreadyCopied;
+            EdsRelease(child);
+            // everything before it is older, so it has been synced too
+            if (backwards)
+                m_ingest.listNext = m_ingest.listCount;
+        } else {
+            m_ingest.listedFiles.push_back(item);
+            ++m_ingest.report.found;
+            m_ingest.report.bytesFound += item.size;
+        }
+
+        // reading a file takes longer than a whole batch of listing
+        if (readCard)
+            break;
+    }
+
+    if (m_ingest.listNext < m_ingest.listCount)
+        return;
+
+    // the folder's own files go before its subfolders, and the subfolders
+    // before whatever was waiting, so the card is walked in order
+    sort(m_ingest.listedFiles.begin(), m_ingest.listedFiles.end(), &Camera::ingestOrder);
+    m_ingest.files.insert(m_ingest.files.end(), m_ingest.listedFiles.begin(), m_ingest.listedFiles.end());
+    m_ingest.listedFiles.clear();
+
+    sort(m_ingest.listedFolders.begin(), m_ingest.listedFolders.end(), &Camera::ingestFolderOrder);
+    for (int i = (int) m_ingest.listedFolders.size() - 1; i >= 0; i--)
+        m_ingest.folders.push_front(m_ingest.listedFolders[i]);
+    m_ingest.listedFolders.clear();
+
+    EdsRelease(m_ingest.listing.ref);
+    m_ingest.listingFolder = false;
+}
+
+int Camera::dcfFileNumber(const string & name)
+{
+    string title = getFilenameWithoutExtension(name);
+    size_t start = title.length();
+    while (start > 0 && isdigit((unsigned char) title[start - 1]))
+        --start;
+    if (start == title.length())
+        return -1;
+    return atoi(title.c_str() + start);
+}
+
+bool Camera::ingestOrder(const IngestItem & a, const IngestItem & b)
+{
+    // the item info has no time in it, but the camera numbers files in
+    // the order it takes them, whatever the prefix (IMG_, _MG_, MVI_).
+    // the RAW and the JPEG of a picture share a number and stay together.
+    int numberA = dcfFileNumber(a.name);
+    int numberB = dcfFileNumber(b.name);
+    if (numberA != numberB)
+        return numberA < numberB;
+    return a.name < b.name;
+}
+
+bool Camera::ingestFolderOrder(const IngestItem & a, const IngestItem & b)
+{
+    // DCF folders start with a three digit number, like 100CANON, so the
+    // name sorts them in the order they were made
+    return a.name < b.name;
+}
+
+void Camera::queueIngestFile(const IngestItem & file)
+{
+    TransferItem item;
+    // the transfer thread releases it
+    item.sdkRef = file.ref;
+    item.outFile = pathCombine(m_ingest.folder, file.name);
+    item.toMemory = false;
+    item.transfer = ++m_transferCount;
+    item.frame = 0;
+    item.wantPreview = false;
+    item.checksum = m_checksum;
+    item.durability = m_durability;
+    item.backupFolders = m_backupFolders;
+    // a whole card would not fit
+    item.keepData = false;
+    item.ingest = true;
+    item.requestTime = Utils::monotonicMicros();
+
+    m_ingest.inFlight[item.transfer] = file;
+    {
+        Lock lock(m_transferMutex);
+        m_transferQueue.push(item);
+    }
+    m_transferJobs.post();
+}
+
+void Camera::ingestFileDone(FinishedTransfer & transfer)
+{
+    map<int, IngestItem>::iterator it = m_ingest.inFlight.find(transfer.transfer);
+    if (it == m_ingest.inFlight.end())
+        return;
+    IngestItem file = it->second;
+    m_ingest.inFlight.erase(it);
+
+    IngestReport & report = m_ingest.report;
+    if (transfer.success) {
+        ++report.copied;
+        report.bytesCopied += transfer.size;
+
+        if (m_manifest.isOpen()) {
+            Manifest::Entry entry;
+            entry.path = file.path;
+            entry.size = file.size;
+            entry.timestamp = time(NULL);
+            entry.taken = takenTime(transfer.picture.metadata);
+            entry.checksum = transfer.picture.checksum;
+            if (! m_manifest.add(entry)) {
+                // it is on the disk, it just gets copied again next time
+                *s_err << m_manifest.error();
+                pushErrMsg(Warning);
+            }
+        }
+
+        Lock lock(m_pictureDoneMutex);
+        m_ingestedFiles.push_back(CompletedPicture());
+        m_ingestedFiles.back().swap(transfer.picture);
+        while ((int) m_ingestedFiles.size() > c_maxIngestedFiles)
+            m_ingestedFiles.pop_front();
+    } else {
+        ++report.failed;
+    }
+
+    finishIngestIfDone();
+}
+
+void Camera::finishIngestIfDone()
+{
+    if (! m_ingest.running || ! m_ingest.inFlight.empty() || ! m_ingest.files.empty()
+        || ! m_ingest.folders.empty() || m_ingest.listingFolder)
+        return;
+
+    m_ingest.running = false;
+    m_ingest.report.running = false;
+    m_ingest.report.endTime = Utils::monotonicMicros();
+
+    IngestReport report = ingestReport();
+    *s_err << "Ingest finished: " << report.copied << " of " << report.found << " files copied at "
+        << report.megabytesPerSecond << " MB/s";
+    if (m_ingest.sync)
+        *s_err << ", " << report.alreadyCopied << " already synced";
+    pushErrMsg(Debug);
+}
+
+void Camera::dirItemCreated(EdsDirectoryItemRef item)
+{
+    // the ref belongs to the SDK and goes away when the event handler
+    // returns unless we hang on to it
+    EdsError err = EdsRetain(item);
+    if (err) {
+        *s_err << "Unable to retain directory item for sync: " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+        return;
+    }
+
+    EdsDirectoryItemInfo info;
+    err = EdsGetDirectoryItemInfo(item, &info);
+    if (err) {
+        *s_err << "Unable to get directory item info: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning);
+        EdsRelease(item);
+        return;
+    }
+
+    // when the camera saves to the computer too, the picture is on its way
+    // already, as a transfer request
+    EdsUInt32 saveTo = kEdsSaveTo_Host;
+    EdsGetPropertyData(m_cam, kEdsPropID_SaveTo, 0, sizeof(saveTo), &saveTo);
+    if (info.isFolder || (saveTo & kEdsSaveTo_Host)) {
+        EdsRelease(item);
+        return;
+    }
+
+    // new on the card, so whatever the manifest has under the same name is
+    // from before the numbers started over
+    IngestItem file;
+    file.ref = item;
+    file.name = info.szFileName;
+    file.path = cardPath(item);
+    file.size = info.size;
+
+    // straight to the transfer threads; they are not busy with the card
+    // in the middle of a shoot, and the picture should be safe as soon as
+    // it can be
+    ++m_ingest.report.found;
+    m_ingest.report.bytesFound += file.size;
+    queueIngestFile(file);
+}
+
+bool Camera::alreadySynced(const IngestItem & file, bool & readCard)
+{
+    const Manifest::Entry * entry = m_manifest.find(file.path, file.size);
+    if (! entry)
+        return false;
+    if (entry->taken.empty())
+        return true;
+
+    // the same name and size can still be another picture. the card
+    // doesn't say when a file was taken, but its EXIF does.
+    readCard = true;
+    string taken = takenTime(file.ref, file.size);
+    // if that can't be read, name and size are all there is to go by
+    return taken.empty() || taken == entry->taken;
+}
+
+string Camera::takenTime(const Exif::Metadata & metadata)
+{
+    string taken = metadata.dateTimeOriginal;
+    if (! taken.empty() && metadata.subSecTimeOriginal[0])
+        taken = taken + "." + metadata.subSecTimeOriginal;
+    return taken;
+}
+
+string Camera::takenTime(EdsDirectoryItemRef item, long long size)
+{
+    // the EXIF is at the start of the file, for JPEGs and CR2s alike
+    EdsUInt32 readSize = size < c_takenTimeReadSize ? (EdsUInt32) size : c_takenTimeReadSize;
+    EdsStreamRef stream = NULL;
+    if (EdsCreateMemoryStream(readSize, &stream) != EDS_ERR_OK || ! stream)
+        return string();
+
+    string taken;
+    if (EdsDownload(item, readSize, stream) == EDS_ERR_OK) {
+        EdsVoid * pointer = NULL;
+        EdsGetPointer(stream, &pointer);
+        Exif::Metadata metadata;
+        if (pointer && Exif::parse((const unsigned char *) pointer, readSize, metadata))
+            taken = takenTime(metadata);
+    }
+    // the rest of the file isn't wanted
+    if ((long long) readSize < size)
+        EdsDownloadCancel(item);
+    else
+        EdsDownloadComplete(item);
+    EdsRelease(stream);
+    return taken;
+}
+
+string Camera::cardPath(EdsDirectoryItemRef item)
+{
+    // up through the parents to DCIM. the volume above it isn't part of
+    // the path, so a file is the same file on either card.
+    string path;
+    EdsBaseRef current = item;
+    EdsRetain(current);
+    while (current) {
+        EdsDirectoryItemInfo info;
+        if (EdsGetDirectoryItemInfo(current, &info) != EDS_ERR_OK)
+            break;
+        path = path.empty() ? string(info.szFileName) : string(info.szFileName) + "/" + path;
+        if (string(info.szFileName) == "DCIM")
+            break;
+
+        EdsBaseRef parent = NULL;
+        if (EdsGetParent(current, &parent) != EDS_ERR_OK)
+            parent = NULL;
+        EdsRelease(current);
+        current = parent;
+    }
+    if (current)
+        EdsRelease(current);
+    return path;
+}
+
+string Camera::bodyID()
+{
+    EdsDataType type = kEdsDataType_Unknown;
+    EdsUInt32 size = 0;
+    EdsError err = EdsGetPropertySize(m_cam, kEdsPropID_BodyID, 0, &type, &size);
+    if (err) {
+        *s_err << "Unable to get the camera's serial number: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning);
+        return string();
+    }
+
+    // older bodies give a number, newer ones a string
+    stringstream id;
+    if (type == kEdsDataType_UInt32) {
+        EdsUInt32 number = 0;
+        err = EdsGetPropertyData(m_cam, kEdsPropID_BodyID, 0, sizeof(number), &number);
+        id << number;
+    } else {
+        vector<char> text(size + 1, 0);
+        err = EdsGetPropertyData(m_cam, kEdsPropID_BodyID, 0, size, &text[0]);
+        id << &text[0];
+    }
+    if (err) {
+        *s_err << "Unable to get the camera's serial number: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning);
+        return string();
+    }
+    return id.str();
+}
+
+EdsPoint Camera::zoomPosition() const
+{
+    return m_zoomPosition;
+}
+
+void Camera::setZoomPosition(EdsPoint position)
+{
+    m_pendingZoomPoint = position;
+    m_pendingZoomPosition = true;
+}
+
+int Camera::zoomRatio() const
+{
+    return m_zoomRatio;
+}
+
+void Camera::setZoomRatio(int zoomRatio)
+{
+    m_zoomRatio = zoomRatio;
+    m_pendingZoomRatio = true;
+}
+
+EdsWhiteBalance Camera::whiteBalance() const
+{
+    EdsError err = EdsGetPropertyData(m_cam, kEdsPropID_WhiteBalance, 0, sizeof(m_whiteBalance), (EdsVoid *) &m_whiteBalance);
+    if (err) {
+        *s_err << "Unable to get white balance: " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+    }
+    return m_whiteBalance;
+}
+
+void Camera::setWhiteBalance(EdsWhiteBalance whiteBalance) 
+{
+    m_whiteBalance = whiteBalance;
+    m_pendingWhiteBalance = true;
+}
+
+Camera::MeteringMode Camera::meteringMode() const
+{
+    EdsUInt32 mode;
+    EdsError err = EdsGetPropertyData(m_cam, kEdsPropID_MeteringMode, 0, sizeof(EdsUInt32), (EdsVoid *) &mode);
+    if (err) {
+        *s_err << "Unable to get metering mode: " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+    }
+    return (MeteringMode) mode;
+}
+
+void Camera::setMeteringMode(MeteringMode mode)
+{
+    EdsUInt32 edsMode = mode;
+    EdsError err = EdsSetPropertyData(m_cam, kEdsPropID_MeteringMode, 0, sizeof(EdsUInt32), &edsMode);
+    if (err) {
+        *s_err << "Unable to set metering mode: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning);
+    }
+}
+
+Camera::DriveMode Camera::driveMode() const
+{
+    EdsUInt32 mode;
+    EdsError err = EdsGetPropertyData(m_cam, kEdsPropID_DriveMode, 0, sizeof(EdsUInt32), (EdsVoid *) &mode);
+    if (err) {
+        *s_err << "Unable to get drive mode: " << ErrorMap::errorMsg(err);
+        pushErrMsg();
+    }
+    return (DriveMode) mode;
+}
+
+bool Camera::setDriveMode(DriveMode mode)
+{
+    EdsUInt32 edsMode = mode;
+    EdsError err = EdsSetPropertyData(m_cam, kEdsPropID_DriveMode, 0, sizeof(EdsUInt32), &edsMode);
+    if (err) {
+        *s_err << "Unable to set drive mode: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning);
+        return false;
+    }
+    return true;
+}
+
+Camera::AFMode Camera::afMode() const
+{
+    EdsUInt32 mode;
     EdsError err = EdsGetPropertyData(m_cam, kEdsPropID_AFMode, 0, sizeof(EdsUInt32), (EdsVoid *) &mode);
     if (err) {
         *s_err << "Unable to get AF mode: " << ErrorMap::errorMsg(err);
@@ -1157,36 +3716,423 @@ void Camera::setPictureCompleteCallback(takePictureCompleteCallback callback)
     m_pictureCompleteCallback = callback;
 }
 
+void Camera::setPictureDataCallback(takePictureDataCallback callback)
+{
+    m_pictureDataCallback = callback;
+}
+
+void Camera::setPictureDoneCallback(takePictureDataCallback callback)
+{
+    m_pictureDoneCallback = callback;
+}
+
+void Camera::setChecksum(Checksum::Algorithm algorithm)
+{
+    m_checksum = algorithm;
+}
+
+Checksum::Algorithm Camera::checksum() const
+{
+    return m_checksum;
+}
+
+void Camera::setDurability(Durability durability, int groupCommitInterval)
+{
+    m_durability = durability;
+
+    Lock lock(m_transferMutex);
+    m_groupCommitInterval = groupCommitInterval;
+}
+
+Camera::Durability Camera::durability() const
+{
+    return m_durability;
+}
+
+void Camera::setBackupFolders(const vector<string> & folders)
+{
+    m_backupFolders = folders;
+}
+
+vector<string> Camera::backupFolders() const
+{
+    return m_backupFolders;
+}
+
+void Camera::setKeepPictureData(bool keep)
+{
+    m_keepPictureData = keep;
+}
+
+void Camera::setDerivatives(DecodePool * pool, const vector<Derivative> & derivatives)
+{
+    DecodePool * oldPool;
+    int oldChannel;
+    {
+        Lock lock(m_derivativeMutex);
+        oldPool = m_derivativePool;
+        oldChannel = m_derivativeChannel;
+        m_derivativePool = NULL;
+        m_derivativeChannel = -1;
+    }
+    // not under the lock, since this waits for makeDerivatives() to
+    // finish. a transfer thread waiting for room is let go and fails.
+    if (oldPool) {
+        oldPool->closeChannel(oldChannel);
+        // what was still waiting for the pool never will be done
+        Lock lock(m_pendingDerivativesMutex);
+        m_pendingDerivatives.clear();
+    }
+
+    m_derivatives.clear();
+    if (! pool || derivatives.empty())
+        return;
+    m_derivatives = derivatives;
+
+    int channel = pool->addChannel(NULL, this, c_derivativeQueueDepth, 1, &Camera::staticMakeDerivatives);
+    Lock lock(m_derivativeMutex);
+    m_derivativePool = pool;
+    m_derivativeChannel = channel;
+}
+
+bool Camera::popDerivative(DerivativeDone & done)
+{
+    Lock lock(m_pictureDoneMutex);
+    if (m_derivativesDone.empty())
+        return false;
+
+    done = m_derivativesDone.front();
+    m_derivativesDone.pop_front();
+    return true;
+}
+
+// runs on the transfer thread, so no s_err in here
+void Camera::queueDerivatives(const string & filename, vector<unsigned char> & data, const vector<Derivative> & derivatives)
+{
+    // decode only as big as the biggest derivative needs
+    int maxSize = 0;
+    for (unsigned int i = 0; i < derivatives.size(); i++) {
+        if (derivatives[i].maxSize > maxSize)
+            maxSize = derivatives[i].maxSize;
+    }
+    int scaleDenominator = 1;
+    int width, height;
+    if (Jpeg::readSize(&data[0], data.size(), width, height))
+        scaleDenominator = Jpeg::scaleDenominatorFor(width, height, maxSize);
+
+    PendingDerivatives pending;
+    pending.source = filename;
+    pending.derivatives = derivatives;
+    pending.savedTime = Utils::monotonicMicros();
+
+    DecodePool * pool;
+    int channel;
+    int sequence;
+    {
+        Lock lock(m_derivativeMutex);
+        pool = m_derivativePool;
+        channel = m_derivativeChannel;
+        sequence = ++m_derivativeSequence;
+    }
+
+    string error;
+    if (! pool) {
+        error = "derivatives were turned off";
+    } else {
+        {
+            Lock pendingLock(m_pendingDerivativesMutex);
+            m_pendingDerivatives[sequence] = pending;
+        }
+        // waits while the pool is behind, which holds this transfer thread
+        // back rather than lose the picture's derivatives. setDerivatives()
+        // can close the channel meanwhile, which is when this fails.
+        if (! pool->submit(channel, sequence, data, scaleDenominator)) {
+            Lock pendingLock(m_pendingDerivativesMutex);
+            m_pendingDerivatives.erase(sequence);
+            error = "derivatives were turned off";
+        }
+    }
+
+    if (! error.empty()) {
+        for (unsigned int i = 0; i < derivatives.size(); i++) {
+            DerivativeDone done;
+            done.source = filename;
+            done.name = derivatives[i].name;
+            done.width = 0;
+            done.height = 0;
+            done.success = false;
+            done.error = error;
+            done.latency = 0;
+            derivativeDone(done);
+        }
+    }
+}
+
+void Camera::staticMakeDerivatives(DecodePool::DecodedFrame & frame, void * context)
+{
+    ((Camera *) context)->makeDerivatives(frame);
+}
+
+// runs on one of the pool's threads, so no s_err in here
+void Camera::makeDerivatives(DecodePool::DecodedFrame & frame)
+{
+    PendingDerivatives pending;
+    {
+        Lock lock(m_pendingDerivativesMutex);
+        map<int, PendingDerivatives>::iterator it = m_pendingDerivatives.find(frame.sequence);
+        if (it == m_pendingDerivatives.end())
+            return;
+        pending = it->second;
+        m_pendingDerivatives.erase(it);
+    }
+
+    // each one is announced as soon as it is on disk, so the small ones
+    // come first if they are asked for first
+    for (unsigned int i = 0; i < pending.derivatives.size(); i++) {
+        const Derivative & derivative = pending.derivatives[i];
+        DerivativeDone done;
+        done.source = pending.source;
+        done.name = derivative.name;
+        done.width = 0;
+        done.height = 0;
+        done.success = false;
+
+        Jpeg::Image image;
+        vector<unsigned char> encoded;
+        string folder = pathCombine(getDirectoryName(pending.source), derivative.name);
+        done.filename = pathCombine(folder, getFilenameWithoutExtension(pending.source) + ".jpg");
+        if (! frame.success) {
+            done.error = "Unable to decode the picture";
+        } else {
+            Jpeg::resize(frame.image, derivative.maxSize, image);
+            done.width = image.width;
+            done.height = image.height;
+            if (! Jpeg::encode(image, derivative.quality, encoded, &done.error))
+                done.error = "Unable to encode it: " + done.error;
+        }
+
+        if (done.error.empty()) {
+            // written under a temporary name like the pictures are, so it
+            // only shows up once it is whole
+            ensurePathExists(folder);
+            string tmpfile = createUniqueFile(done.filename + c_partialFileExtension);
+            FILE * file = tmpfile.empty() ? NULL : fopen(tmpfile.c_str(), "wb");
+            if (! file) {
+                done.error = "Unable to create a file in " + folder;
+            } else {
+                bool written = fwrite(&encoded[0], 1, encoded.size(), file) == encoded.size();
+                written = fclose(file) == 0 && written;
+                done.filename = makeUnique(done.filename);
+                if (! written)
+                    done.error = "Unable to write " + tmpfile;
+                else if (! moveFile(tmpfile, done.filename))
+                    done.error = "Unable to move it from " + tmpfile;
+                else
+                    done.success = true;
+                if (! done.success)
+                    remove(tmpfile.c_str());
+            }
+        }
+
+        done.latency = Utils::monotonicMicros() - pending.savedTime;
+        if (! done.success) {
+            stringstream msg;
+            msg << "Unable to make the " << derivative.name << " derivative of " << pending.source << ": " << done.error;
+            pushErrMsg(Warning, msg.str());
+        }
+        derivativeDone(done);
+    }
+}
+
+void Camera::derivativeDone(const DerivativeDone & done)
+{
+    Lock lock(m_pictureDoneMutex);
+    m_derivativesDone.push_back(done);
+}
+
+const char * Camera::durabilityName(Durability durability)
+{
+    switch (durability) {
+        case Unflushed: return "none";
+        case FlushEachFile: return "file";
+        case GroupCommit: return "group";
+    }
+    return "unknown";
+}
+
+void Camera::setPicturePreviews(bool enabled)
+{
+    m_picturePreviews = enabled;
+}
+
+void Camera::setPicturePreviewCallback(picturePreviewCallback callback)
+{
+    m_picturePreviewCallback = callback;
+}
+
+bool Camera::popPicturePreview(PicturePreview & preview)
+{
+    Lock lock(m_pictureDoneMutex);
+    if (m_previewQueue.empty())
+        return false;
+
+    PicturePreview & front = m_previewQueue.front();
+    preview.transfer = front.transfer;
+    preview.cameraFilename = front.cameraFilename;
+    preview.data.swap(front.data);
+    preview.requestTime = front.requestTime;
+    preview.previewTime = front.previewTime;
+    m_previewQueue.pop_front();
+    return true;
+}
+
 int Camera::pictureDoneQueueSize() const
 {
+    Lock lock(m_pictureDoneMutex);
     return m_pictureDoneQueue.size();
 }
 
 string Camera::popPictureDoneQueue()
 {
-    if (pictureDoneQueueSize() == 0) {
+    Lock lock(m_pictureDoneMutex);
+    if (m_pictureDoneQueue.empty()) {
         return string();
     } else {
-        string value = m_pictureDoneQueue.front();
+        string value = m_pictureDoneQueue.front().filename;
         m_pictureDoneQueue.pop();
         return value;
     }
 }
 
+bool Camera::popCompletedPicture(CompletedPicture & picture)
+{
+    Lock lock(m_pictureDoneMutex);
+    if (m_pictureDoneQueue.empty())
+        return false;
+
+    picture.swap(m_pictureDoneQueue.front());
+    m_pictureDoneQueue.pop();
+    return true;
+}
+
+Camera::LiveViewConsumer * Camera::addLiveViewConsumer()
+{
+    LiveViewConsumer * consumer = m_liveView->m_frames.addConsumer();
+    if (! consumer) {
+        *s_err << "Too many live view consumers, the limit is " << LiveView::c_maxConsumers;
+        pushErrMsg(Warning);
+        return NULL;
+    }
+    m_liveView->m_consumers.push_back(consumer);
+    return consumer;
+}
+
+const Camera::LiveViewFrame * Camera::acquireLiveViewFrame(LiveViewConsumer * consumer, bool * isNew)
+{
+    return m_liveView->m_frames.acquire(consumer, isNew);
+}
+
+void Camera::releaseLiveViewFrame(LiveViewConsumer * consumer)
+{
+    m_liveView->m_frames.release(consumer);
+}
+
+const vector<Camera::LiveViewConsumer *> & Camera::liveViewConsumers() const
+{
+    return m_liveView->m_consumers;
+}
+
+void Camera::acquireLiveViewFrame()
+{
+    bool isNew;
+    const LiveViewFrame * frame = acquireLiveViewFrame(m_liveView->m_defaultConsumer, &isNew);
+
+    // only count the first time we look at a frame
+    if (! frame || ! isNew)
+        return;
+
+    m_liveView->m_defaultAcquireTime = Utils::monotonicMicros();
+
+    LiveViewStats & stats = m_liveView->m_stats;
+    stats.acquireLatency.add(m_liveView->m_defaultAcquireTime - frame->info.downloadTime);
+    stats.endToEndLatency.add(m_liveView->m_defaultAcquireTime - frame->info.requestTime);
+}
+
+void Camera::releaseLiveViewFrame()
+{
+    releaseLiveViewFrame(m_liveView->m_defaultConsumer);
+}
+
 const unsigned char * Camera::liveViewFrameBuffer() const
 {
-    return m_liveView->m_frameBuffer;
+    const LiveViewFrame * frame = m_liveView->m_frames.held(m_liveView->m_defaultConsumer);
+    return frame ? frame->buffer : NULL;
 }
 
 int Camera::liveViewFrameBufferSize() const
 {
-    return m_liveView->c_frameBufferSize;
+    const LiveViewFrame * frame = m_liveView->m_frames.held(m_liveView->m_defaultConsumer);
+    return frame ? frame->length : 0;
+}
+
+Camera::LiveViewFrameInfo Camera::liveViewFrameInfo() const
+{
+    const LiveViewFrame * frame = m_liveView->m_frames.held(m_liveView->m_defaultConsumer);
+    if (! frame) {
+        LiveViewFrameInfo none;
+        none.sequence = 0;
+        none.requestTime = 0;
+        none.downloadTime = 0;
+        none.acquireTime = 0;
+        return none;
+    }
+
+    LiveViewFrameInfo info = frame->info;
+    info.acquireTime = m_liveView->m_defaultAcquireTime;
+    return info;
+}
+
+const Camera::LiveViewStats & Camera::liveViewStats() const
+{
+    m_liveView->accountTimeInState();
+    return m_liveView->m_stats;
+}
+
+void Camera::resetLiveViewStats()
+{
+    m_liveView->accountTimeInState();
+    m_liveView->m_stats = LiveViewStats();
+}
+
+void Camera::setLiveViewDecoder(DecodePool * pool, DecodePool::DecodedFrameCallback callback, void * context, int scaleDenominator)
+{
+    if (m_decodePool)
+        m_decodePool->closeChannel(m_decodeChannel);
+
+    m_decodePool = pool;
+    m_decodeChannel = -1;
+    if (m_decodePool)
+        m_decodeChannel = m_decodePool->addChannel(callback, context, LiveView::c_decodeQueueDepth, scaleDenominator);
+}
+
+bool Camera::liveViewDecodeStats(DecodePool::ChannelStats & stats) const
+{
+    if (! m_decodePool)
+        return false;
+
+    stats = m_decodePool->channelStats(m_decodeChannel);
+    return true;
 }
 
 bool Camera::grabLiveViewFrame()
 {
+    checkLiveViewTimeout();
+
+    long long requestTime = Utils::monotonicMicros();
+
     // skip frames if the camera isn't ready yet.
     if (m_liveView->m_state != LiveView::On) {
+        ++m_liveView->m_stats.framesSkippedNotOn;
         *s_err << "Skipping live view frame because camera is not in live view mode";
         if (m_liveView->m_state == LiveView::WaitingToStart)
             *s_err << " yet";
@@ -1194,11 +4140,33 @@ bool Camera::grabLiveViewFrame()
         return false;
     }
 
+    // the camera is busy taking a picture, don't interrupt it
+    if (m_liveView->m_exposing) {
+        ++m_liveView->m_stats.framesSkippedExposing;
+        *s_err << "Skipping live view frame because a picture is being taken";
+        pushErrMsg(Debug);
+        return false;
+    }
+
     EdsError err;
     EdsImageRef img = NULL;
 
+    // nobody is looking at this frame and nobody will until we publish it
+    LiveViewFrame * frame = m_liveView->m_frames.beginWrite();
+    if (! frame) {
+        *s_err << "Skipping live view frame because every frame buffer is in use";
+        pushErrMsg(Warning);
+        return false;
+    }
+    err = EdsSeek(frame->stream, 0, kEdsSeek_Begin);
+    if (err) {
+        *s_err << "Unable to rewind live view frame buffer: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Error);
+        return false;
+    }
+
     // create image
-    err = EdsCreateEvfImageRef(m_liveView->m_streamPtr, &img);
+    err = EdsCreateEvfImageRef(frame->stream, &img);
     if (err) {
         *s_err << "Unable to create live view frame on the camera: " << ErrorMap::errorMsg(err);
         pushErrMsg(Error);
@@ -1217,6 +4185,7 @@ bool Camera::grabLiveViewFrame()
         // skip the frame if the camera isn't ready
         *s_err << "skipping live view frame because camera isn't ready";
         pushErrMsg(Warning);
+        ++m_liveView->m_stats.framesSkippedNotReady;
         EdsRelease(img);
         return false;
     } else if (err) {
@@ -1227,6 +4196,39 @@ bool Camera::grabLiveViewFrame()
         return false;
     }
 
+    // the stream position tells us how much jpeg data we got. the buffer
+    // moves when the stream has to grow, so it is looked up every time.
+    EdsUInt32 length = 0;
+    EdsVoid * buffer = NULL;
+    err = EdsGetPosition(frame->stream, &length);
+    if (! err)
+        err = EdsGetPointer(frame->stream, &buffer);
+    if (err || length == 0 || ! buffer) {
+        *s_err << "skipping live view frame, it came without any data: " << ErrorMap::errorMsg(err);
+        pushErrMsg(Warning);
+        EdsRelease(img);
+        return false;
+    }
+    frame->buffer = (unsigned char *) buffer;
+    frame->length = length;
+
+    LiveViewFrameInfo & info = frame->info;
+    info.sequence = ++m_liveView->m_sequence;
+    info.requestTime = requestTime;
+    info.downloadTime = Utils::monotonicMicros();
+    info.acquireTime = 0;
+
+    m_liveView->m_frames.publish();
+
+    LiveViewStats & stats = m_liveView->m_stats;
+    ++stats.framesGrabbed;
+    stats.downloadLatency.add(info.downloadTime - info.requestTime);
+
+    // the pool copies the frame, so it doesn't matter when we overwrite it.
+    // if the pool is backed up this frame is dropped, which it counts.
+    if (m_decodePool)
+        m_decodePool->submit(m_decodeChannel, info.sequence, frame->buffer, frame->length);
+
     // get/set zoom ratio
     if (m_pendingZoomRatio) {
         err = EdsSetPropertyData(m_cam, kEdsPropID_Evf_Zoom, 0, sizeof(EdsUInt32), &m_zoomRatio);
@@ -1283,33 +4285,8 @@ bool Camera::grabLiveViewFrame()
 
 bool Camera::startLiveView()
 {
-    switch (m_liveView->m_state) {
-        case LiveView::Paused:
-            *s_err << "startLiveView(): Live view paused, will resume in a moment.";
-            pushErrMsg(Warning);
-            return true;
-        case LiveView::Off:
-            if (! _startLiveView())
-                return false;
-            m_liveView->m_desiredNewState = LiveView::On;
-            return true;
-        case LiveView::WaitingToStop:
-            *s_err << "Waiting for live view to end so we can start it again.";
-            pushErrMsg(Debug);
-            m_liveView->m_desiredNewState = LiveView::On;
-            return true;
-        case LiveView::WaitingToStart:
-            *s_err << "startLiveView(): already waiting to start live view.";
-            pushErrMsg(Warning);
-            m_liveView->m_desiredNewState = LiveView::On;
-            return true;
-        case LiveView::On:
-            *s_err << "startLiveView(): Live view already on";
-            pushErrMsg(Warning);
-            return true;
-    }
-    assert(false);
-    return false;
+    checkLiveViewTimeout();
+    return handleLiveViewEvent(LiveView::StartRequested);
 }
 
 bool Camera::_startLiveView()
@@ -1335,35 +4312,15 @@ bool Camera::_startLiveView()
 
     *s_err << "Requested live view to turn on.";
     pushErrMsg(Debug);
-    m_liveView->m_state = LiveView::WaitingToStart;
+    m_liveView->setState(LiveView::WaitingToStart);
 
     return true;
 }
 
 bool Camera::stopLiveView()
 {
-    switch (m_liveView->m_state) {
-        case LiveView::Paused:
-            *s_err << "stopLiveView(): Live view already paused";
-            pushErrMsg(Debug);
-            m_liveView->m_state = LiveView::Off;
-            return true;
-        case LiveView::Off:
-            *s_err << "stopLiveView(): Live view already off";
-            pushErrMsg(Debug);
-            return true;
-        case LiveView::WaitingToStop:
-        case LiveView::WaitingToStart:
-            m_liveView->m_desiredNewState = LiveView::Off;
-            return true;
-        case LiveView::On:
-            if (! _stopLiveView())
-                return false;
-            m_liveView->m_desiredNewState = LiveView::Off;
-            return true;
-    }
-    assert(false);
-    return false;
+    checkLiveViewTimeout();
+    return handleLiveViewEvent(LiveView::StopRequested);
 }
 
 bool Camera::_stopLiveView()
@@ -1388,7 +4345,7 @@ bool Camera::_stopLiveView()
         return false;
     }
 
-    m_liveView->m_state = LiveView::WaitingToStop;
+    m_liveView->setState(LiveView::WaitingToStop);
 
     return true;
 }
@@ -1441,26 +4398,35 @@ void Camera::terminate()
 }
 
 void Camera::pushErrMsg(ErrorLevel level)
+{
+    pushErrMsg(level, s_err->str());
+
+    delete s_err;
+    s_err = new stringstream;
+}
+
+void Camera::pushErrMsg(ErrorLevel level, const string & message)
 {
     if (level >= s_errorLevel) {
         ErrorMessage msg;
         msg.level = level;
-        msg.msg = s_err->str();
+        msg.msg = message;
+
+        Lock lock(s_errMsgMutex);
         s_errMsgQueue.push(msg);
     }
-
-    delete s_err;
-    s_err = new stringstream;
 }
 
 int Camera::errMsgQueueSize()
 {
+    Lock lock(s_errMsgMutex);
     return s_errMsgQueue.size();
 }
 
 Camera::ErrorMessage Camera::popErrMsg()
 {
-    if (errMsgQueueSize() == 0) {
+    Lock lock(s_errMsgMutex);
+    if (s_errMsgQueue.empty()) {
         return ErrorMessage();
     } else {
         ErrorMessage value = s_errMsgQueue.front();
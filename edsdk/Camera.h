@@ -4,6 +4,8 @@
 #include <string>
 #include <map>
 #include <queue>
+#include <deque>
+#include <vector>
 #include <sstream>
 using namespace std;
 
@@ -11,11 +13,124 @@ using namespace std;
 #include "EDSDKErrors.h"
 #include "EDSDKTypes.h"
 
+#include "Checksum.h"
+#include "DecodePool.h"
+#include "Histogram.h"
+#include "Mailbox.h"
+#include "Manifest.h"
+#include "Exif.h"
+#include "StreamAdapter.h"
+#include "Threading.h"
+
 class Camera
 {
     public: // variables
         typedef void (* takePictureCompleteCallback) (string filename);
 
+        // how sure we make that a picture is on the disk before handing it
+        // out. see setDurability().
+        enum Durability {
+            // leave it to the OS, which writes it out within a few seconds.
+            // a crash or a pulled plug before then loses it.
+            Unflushed,
+            // flush every file as it finishes downloading. the transfer
+            // thread waits for the disk before it takes the next one.
+            FlushEachFile,
+            // flush the files that finished over a few milliseconds
+            // together, on a thread of their own
+            GroupCommit,
+        };
+
+        // a backup of a file, see setBackupFolders()
+        struct PictureCopy {
+            // where it went, or was meant to go
+            string filename;
+            bool success;
+            // why not
+            string error;
+        };
+
+        // one file of a picture, like the RAW of a RAW+JPEG shot
+        struct PictureFile {
+            // where it was saved. empty if it was kept in memory.
+            string filename;
+            // what the camera called it, for example IMG_0042.JPG
+            string cameraFilename;
+            // the picture itself, if it was kept in memory or
+            // setKeepPictureData() is on
+            vector<unsigned char> data;
+            // worked out while it downloaded, see setChecksum() and
+            // Checksum::digest(). empty if checksums are off.
+            string checksum;
+            // what the file got, which can fall short of what was asked
+            // for if flushing failed. always Unflushed in memory.
+            Durability durability;
+            // one per backup folder
+            vector<PictureCopy> copies;
+            // read from the picture as it came in. not valid for files
+            // without EXIF, like movies and CR3s.
+            Exif::Metadata metadata;
+
+            // pictures can be big, so they get moved around rather than
+            // copied
+            void swap(PictureFile & other);
+        };
+
+        // a picture that has come off the camera
+        struct CompletedPicture : PictureFile {
+            // the other files the camera made for the same picture. with
+            // RAW+JPEG the JPEG goes above and the RAW in here.
+            vector<PictureFile> companions;
+
+            void swap(CompletedPicture & other);
+        };
+        // you can swap the data out of the picture if you want to keep it
+        typedef void (* takePictureDataCallback) (CompletedPicture & picture);
+
+        // a smaller copy of a picture, see setDerivatives()
+        struct Derivative {
+            // the folder next to the picture that it goes in, like "web"
+            string name;
+            // of the long edge, in pixels. pictures that are already
+            // smaller keep their size.
+            int maxSize;
+            // JPEG quality, 1 to 100
+            int quality;
+        };
+
+        // a derivative that was written, or couldn't be
+        struct DerivativeDone {
+            // the picture it was made from
+            string source;
+            // see Derivative::name
+            string name;
+            // where it went
+            string filename;
+            int width;
+            int height;
+            bool success;
+            // why not
+            string error;
+            // from the picture being saved to this being written, in
+            // microseconds
+            long long latency;
+        };
+
+        // the thumbnail the camera keeps in a picture, which comes off long
+        // before the picture itself
+        struct PicturePreview {
+            // matches TransferProgress::transfer
+            int transfer;
+            string cameraFilename;
+            // a small jpeg
+            vector<unsigned char> data;
+            // microseconds, see Utils::monotonicMicros(). when the camera
+            // asked us to download the picture and when the preview was in.
+            long long requestTime;
+            long long previewTime;
+        };
+        typedef void (* picturePreviewCallback) (PicturePreview & preview);
+
         enum CameraState {
             Ready,
             TooManyCameras,
@@ -61,12 +176,271 @@ class Camera
             ManualFocus = 3,
         };
 
+        // what to do with live view when we take a picture
+        enum CaptureLiveViewMode {
+            // stop live view before the shutter and start it again once the
+            // picture has been transferred. works on every body but blanks
+            // the preview for a few seconds.
+            RestartLiveView,
+            // leave live view running through the shutter and only stop
+            // grabbing frames during the exposure. falls back to
+            // RestartLiveView on bodies that can't do it.
+            KeepLiveView,
+        };
+
         struct CameraModelData {
             EdsPoint zoom100MaxPosition;
             EdsPoint zoom500MaxPosition;
             EdsSize zoom100ImageSize;
             EdsSize zoom500ImageSize;
             EdsSize zoomBoxSize;
+            // whether the body keeps streaming live view across a capture
+            bool liveViewSurvivesCapture;
+        };
+
+        // timestamps are in microseconds, see Utils::monotonicMicros()
+        struct LiveViewFrameInfo {
+            // goes up by one every time a new frame lands in the frame buffer
+            int sequence;
+            // when grabLiveViewFrame() asked the camera for the frame
+            long long requestTime;
+            // when EdsDownloadEvfImage finished putting it in the frame buffer
+            long long downloadTime;
+            // when the default consumer (the python buffer) first acquired
+            // the frame. 0 if it hasn't yet.
+            long long acquireTime;
+        };
+
+        // a live view frame as it sits in the frame mailbox
+        struct LiveViewFrame {
+            // the inside of stream
+            unsigned char * buffer;
+            // how many bytes of jpeg data are in buffer
+            int length;
+            LiveViewFrameInfo info;
+            // memory stream the frame is downloaded into
+            EdsStreamRef stream;
+        };
+
+        typedef Mailbox<LiveViewFrame>::Consumer LiveViewConsumer;
+
+        struct LiveViewStats {
+            int framesGrabbed;
+            // the camera said EDS_ERR_OBJECT_NOTREADY
+            int framesSkippedNotReady;
+            // live view was not in the On state
+            int framesSkippedNotOn;
+            // a picture was being exposed in KeepLiveView mode
+            int framesSkippedExposing;
+
+            // request -> download complete
+            Histogram downloadLatency;
+            // download complete -> consumer acquire. how stale displayed frames are.
+            Histogram acquireLatency;
+            // request -> consumer acquire
+            Histogram endToEndLatency;
+
+            // how long the camera took to confirm that live view started or
+            // stopped, from when we asked it to
+            Histogram startLatency;
+            Histogram stopLatency;
+            // starts and stops which were not confirmed within c_sleepTimeout
+            int transitionTimeouts;
+            // microseconds spent in each live view state, by state name
+            map<string, long long> timeInState;
+
+            LiveViewStats();
+        };
+
+        // how far along a picture download is
+        struct TransferProgress {
+            // counts up from 1 for every picture the camera hands us
+            int transfer;
+            string cameraFilename;
+            int percent;
+            // total size of the picture and roughly how much of it is here
+            long long size;
+            long long bytesDone;
+            // microseconds since the download started
+            long long elapsed;
+        };
+
+        // timestamps are in microseconds, see Utils::monotonicMicros()
+        struct BurstFrame {
+            // 1 for the first frame of the burst
+            int frame;
+            // matches TransferProgress::transfer
+            int transfer;
+            // when the camera said the frame was ready
+            long long captureTime;
+            // when it was saved, 0 if it hasn't been yet
+            long long transferTime;
+            string filename;
+        };
+
+        struct BurstReport {
+            int requested;
+            // when we pressed and let go of the shutter button. releaseTime
+            // is 0 while it is still held down.
+            long long pressTime;
+            long long releaseTime;
+            // can be a few more than requested; the camera finishes what is
+            // in its buffer after we let go
+            vector<BurstFrame> frames;
+            // between the first and the last frame the camera took
+            double captureFps;
+            // saved frames per second since the button was pressed
+            double transferFps;
+
+            BurstReport() : requested(0), pressTime(0), releaseTime(0), captureFps(0), transferFps(0) {}
+        };
+
+        // what to do when a timelapse shot comes due while the last picture
+        // is still being taken or downloaded
+        enum TimelapseBusyPolicy {
+            // leave the shot out
+            SkipWhenBusy,
+            // take it anyway and mark it as overlapped
+            ShootWhenBusy,
+        };
+
+        enum TimelapseShotStatus {
+            ShotTaken,
+            // the camera or the shutter command failed
+            ShotFailed,
+            // the last picture was still in flight, see SkipWhenBusy
+            ShotSkippedBusy,
+            // poll() wasn't called for more than a whole interval. missed
+            // shots are not made up for later.
+            ShotMissed,
+        };
+
+        // timestamps are in microseconds, see Utils::monotonicMicros()
+        struct TimelapseShot {
+            // 1 for the first shot
+            int shot;
+            TimelapseShotStatus status;
+            // start of the timelapse + (shot - 1) * interval
+            long long deadline;
+            // when the shutter command went out, 0 if it didn't
+            long long fireTime;
+            // fireTime - deadline
+            long long jitter;
+            // taken while the previous picture was still in flight
+            bool overlapped;
+            string filename;
+        };
+
+        struct TimelapseReport {
+            long long interval;
+            // 0 means until stopTimelapse()
+            int requested;
+            long long startTime;
+            int taken;
+            int failed;
+            int skippedBusy;
+            int missed;
+            int overlapped;
+            // of every shot that went out
+            Histogram jitter;
+            // the last hundred, oldest first. the counts above cover
+            // them all.
+            deque<TimelapseShot> shots;
+
+            TimelapseReport();
+        };
+
+        // timestamps are in microseconds, see Utils::monotonicMicros()
+        struct BulbExposure {
+            // 1 for the first since the report was started
+            int exposure;
+            bool success;
+            long long requested;
+            // when the open and close commands went out and came back. the
+            // shutter moved somewhere in between.
+            long long startSent;
+            long long startReturned;
+            long long endSent;
+            long long endReturned;
+            // from the middle of the open command to the middle of the
+            // close one
+            long long achieved;
+            // achieved - requested
+            long long error;
+            // how far achieved can be off by, from how long the commands took
+            long long uncertainty;
+            string filename;
+        };
+
+        struct BulbReport {
+            int requested;
+            int taken;
+            int failed;
+            // how far off every exposure taken was, either way. see
+            // BulbExposure::error for which way.
+            Histogram absoluteError;
+            // the last hundred, oldest first. the counts above cover
+            // them all.
+            deque<BulbExposure> exposures;
+
+            BulbReport() : requested(0), taken(0), failed(0) {}
+        };
+
+        // how a bulk ingest is going, see startIngest()
+        struct IngestReport {
+            bool running;
+            // files found on the cards so far, and their size in bytes
+            int found;
+            long long bytesFound;
+            int copied;
+            int failed;
+            // left alone by startSync() because the manifest has them. a
+            // quick sync only counts the ones it looked at.
+            int alreadyCopied;
+            long long bytesCopied;
+            // microseconds, see Utils::monotonicMicros(). endTime is 0
+            // while it is running.
+            long long startTime;
+            long long endTime;
+            // bytesCopied over the time since startTime, in MB (2^20 bytes)
+            // per second
+            double megabytesPerSecond;
+
+            IngestReport();
+        };
+
+        struct TransferStats {
+            int transfersCompleted;
+            int transfersFailed;
+            long long bytesTransferred;
+            // microseconds, EdsDownload start -> finish
+            Histogram downloadTime;
+            // microseconds, DirItemRequestTransfer -> picture saved or in memory
+            Histogram requestToCompletion;
+            // kilobytes per second of every download
+            Histogram throughput;
+            // microseconds, DirItemRequestTransfer -> preview downloaded
+            Histogram requestToPreview;
+            // microseconds, downloaded -> on the disk, for GroupCommit
+            Histogram groupCommitDelay;
+
+            TransferStats();
+        };
+
+        // how long the shutter takes to go off with takeSinglePicture(),
+        // which focuses and meters first, and with takePrefocusedPicture(),
+        // which did that in prefocus(). microseconds.
+        struct ShutterLagStats {
+            // the half press, which prefocus() gets out of the way early
+            Histogram prefocusCommand;
+            // the command that fires, from going out to coming back
+            Histogram takePictureCommand;
+            Histogram prefocusedCommand;
+            // from the command that fires going out to the camera offering
+            // the picture, which is as close to the shutter as the SDK lets
+            // us see
+            Histogram takePictureToRequest;
+            Histogram prefocusedToRequest;
         };
 
     public: // methods
@@ -86,15 +460,175 @@ class Camera
         const CameraModelData * cameraSpecificData() const;
 
         // takes a picture with the camera and puts it in outFile.
+        // the extension of outFile is replaced by the one the camera uses
+        // for the picture, so with RAW+JPEG you get outFile.jpg and
+        // outFile.cr2, handed out together as one CompletedPicture.
         // returns immediately but the picture won't be finished immediately.
+        // you can call it again before the picture is done; every picture
+        // goes to the outFile it was taken with. if the camera hands us more
+        // than one frame for a shot, like in continuous drive mode, they all
+        // go to outFile, with %n replaced by the frame number starting at 1.
         bool takeSinglePicture(string outFile);
+        // same thing but the picture is kept in memory instead of being
+        // written to a file. it is handed to the picture data callback and
+        // put in the picture done queue.
+        bool takeSinglePictureToMemory();
+
+        // presses the shutter button halfway and holds it there, so the
+        // camera focuses and meters now instead of when the picture is
+        // taken. the camera keeps focus until takePrefocusedPicture() or
+        // releaseFocus().
+        bool prefocus();
+        // presses the shutter button the rest of the way, without focusing
+        // again, and saves the picture to outFile like takeSinglePicture().
+        // with keepHolding the button goes back to halfway afterwards, so
+        // the next one can go off just as fast; otherwise it is let go.
+        bool takePrefocusedPicture(string outFile, bool keepHolding = false);
+        // lets go of the shutter button
+        void releaseFocus();
+        bool focusHeld() const;
+        ShutterLagStats shutterLagStats() const;
+        void resetShutterLagStats();
+
+        // holds the shutter button down in the given drive mode until the
+        // camera has taken count pictures, then puts the drive mode back.
+        // frames download while the camera is still shooting. they go to
+        // nameTemplate with %n replaced by the frame number; if there is no
+        // %n, _%n is added before the extension. see lastBurst() for timings.
+        bool takeBurst(int count, string nameTemplate, DriveMode mode = HighSpeedContinuousShooting);
+        // whether the shutter button is still being held for a burst
+        bool burstInProgress() const;
+        // what happened during the most recent burst, so far
+        BurstReport lastBurst() const;
+
+        // takes a picture every intervalMs milliseconds, count times or until
+        // stopTimelapse() if count is 0. shots are timed against a fixed
+        // schedule from the moment this is called, so a late shot doesn't
+        // push the ones after it back. they are fired from poll(); use
+        // pollDelay() to know how long you can sleep. pictures go to
+        // nameTemplate with %n replaced by the shot number; if there is no
+        // %n, _%n is added before the extension.
+        bool startTimelapse(int intervalMs, int count, string nameTemplate, TimelapseBusyPolicy policy = SkipWhenBusy);
+        void stopTimelapse();
+        bool timelapseRunning() const;
+        // what happened to every shot of the current or last timelapse
+        TimelapseReport timelapseReport() const;
+        static const char * timelapseShotStatusName(TimelapseShotStatus status);
+
+        // holds the shutter open for durationMs with the bulb commands. the
+        // camera has to be in bulb mode. the close is timed from poll()
+        // against the performance counter, so keep calling poll() and use
+        // pollDelay() to know how long you can sleep. for the last stretch
+        // that is not at all. if bulb exposures are already going, it waits
+        // its turn.
+        // see bulbReport() for how long each one really was.
+        bool takeBulbExposure(int durationMs, string outFile);
+        // count exposures of durationMs, gapMs from the close of one to the
+        // open of the next. they go to nameTemplate with %n replaced by the
+        // exposure number; if there is no %n, _%n is added before the
+        // extension. queued after any that are already going.
+        bool takeBulbSequence(int count, int durationMs, int gapMs, string nameTemplate);
+        // closes the shutter now and drops the exposures still waiting
+        void cancelBulb();
+        bool bulbInProgress() const;
+        // every exposure since the last one that started with nothing queued
+        BulbReport bulbReport() const;
+
+        // copy every file in the DCIM folders of the camera's cards into
+        // folder, under the camera's names, oldest first. the cards are
+        // listed from poll() a few files at a time while the transfer
+        // threads download what has been listed already. at most
+        // maxInFlight files are handed to them at once, so pictures taken
+        // meanwhile don't wait behind the whole card. checksums, durability
+        // and backup folders apply as they do to pictures being taken.
+        bool startIngest(string folder, int maxInFlight = 4);
+        // like startIngest(), but only copies the files that aren't in
+        // folder's manifest for this body yet, and adds them to it as they
+        // are copied. new files show up at the end of a card folder, so
+        // each folder is listed from the end until a file the manifest has
+        // comes up, unless fullScan is set. a file with the same path and
+        // size as one in the manifest has its start read, to tell by when
+        // it was taken whether it is the same picture. once it has
+        // started, files the camera writes to the card are copied as they
+        // appear, until disconnect() or startIngest(). that is only while
+        // the camera saves to the card alone; pictures it saves to the
+        // computer come through the picture callbacks as usual.
+        bool startSync(string folder, int maxInFlight = 4, bool fullScan = false);
+        // stops handing out files. the ones already handed out finish.
+        void stopIngest();
+        bool ingestRunning() const;
+        IngestReport ingestReport() const;
+        // every file that was copied, oldest first, or the newest
+        // thousand if they weren't popped. returns false if there are none
+        // waiting.
+        bool popIngestedFile(CompletedPicture & file);
+
+        // choose whether taking a picture restarts live view. see CaptureLiveViewMode.
+        void setCaptureLiveViewMode(CaptureLiveViewMode mode);
+        CaptureLiveViewMode captureLiveViewMode() const;
 
         // if you want to be notified when a picture is finally done, use this:
+        // it only gets the first file of the picture, the JPEG of a
+        // RAW+JPEG pair. popCompletedPicture() gets the companions too.
         void setPictureCompleteCallback(takePictureCompleteCallback callback);
+        // called instead for pictures taken with takeSinglePictureToMemory()
+        void setPictureDataCallback(takePictureDataCallback callback);
+
+        // called for every picture, whether it went to a file or to memory,
+        // after the two callbacks above
+        void setPictureDoneCallback(takePictureDataCallback callback);
+
+        // work out a checksum of every picture as it downloads, instead of
+        // reading the file back afterwards. see CompletedPicture::checksum.
+        void setChecksum(Checksum::Algorithm algorithm);
+        Checksum::Algorithm checksum() const;
+
+        // see Durability. with GroupCommit, files wait up to
+        // groupCommitInterval milliseconds for others to be flushed with.
+        // CompletedPicture::durability says what each picture got.
+        void setDurability(Durability durability, int groupCommitInterval = 20);
+        Durability durability() const;
+        static const char * durabilityName(Durability durability);
+
+        // write every picture that goes to a file into these folders as
+        // well, under the same name, as it comes off the camera. a backup
+        // failing doesn't fail the picture, see CompletedPicture::copies.
+        void setBackupFolders(const vector<string> & folders);
+        vector<string> backupFolders() const;
+        // keep the bytes of pictures that go to a file in
+        // CompletedPicture::data too, without reading the file back
+        void setKeepPictureData(bool keep);
+        // make derivatives of every JPEG that is saved to a file, on pool's
+        // threads. the bytes are kept on the way in, each picture is
+        // decoded once, scaled down by libjpeg as far as the biggest
+        // derivative allows, and every derivative goes to popDerivative()
+        // as soon as it is written. an empty list or a NULL pool stops it.
+        void setDerivatives(DecodePool * pool, const vector<Derivative> & derivatives);
+        // oldest first
+        bool popDerivative(DerivativeDone & done);
+
+        // download the thumbnail of every picture before the picture itself
+        // and hand it to the preview callback and the preview queue. off by
+        // default since it costs a little time on every picture.
+        void setPicturePreviews(bool enabled);
+        void setPicturePreviewCallback(picturePreviewCallback callback);
+        // oldest first. the oldest are thrown away if nobody picks them up.
+        // returns false if there are none.
+        bool popPicturePreview(PicturePreview & preview);
 
         // you have to put the camera in "live view mode" before you can get live view frames.
         bool startLiveView();
         bool stopLiveView();
+        // name of the state live view is in, for example "On" or "WaitingToStart"
+        string liveViewState() const;
+
+        // call this regularly from the thread that runs the SDK. it takes care
+        // of things that happen with the passing of time, like giving up on
+        // live view transitions that the camera never confirms.
+        void poll();
+        // how many milliseconds, at most maxDelay, until poll() has
+        // something scheduled to do. sleep this long between calls.
+        int pollDelay(int maxDelay) const;
         // this function refreshes the frame buffer with a new image from the camera.
         bool grabLiveViewFrame();
 
@@ -114,7 +648,8 @@ class Camera
         void setMeteringMode(MeteringMode mode);
 
         DriveMode driveMode() const;
-        void setDriveMode(DriveMode mode);
+        // returns false if the camera wouldn't take it
+        bool setDriveMode(DriveMode mode);
 
         AFMode afMode() const;
         void setAFMode(AFMode mode);
@@ -126,12 +661,56 @@ class Camera
         // get the oldest message from the event queue and remove it.
         // the return value is the filename of the completed picture
         string popPictureDoneQueue();
+        // same thing but with everything we know about the picture, including
+        // its data if it was kept in memory. returns false if the queue is empty.
+        bool popCompletedPicture(CompletedPicture & picture);
         int pictureDoneQueueSize() const;
 
-        // get a pointer to the live view frame data
+        // progress reports of picture downloads, oldest first. the oldest
+        // are thrown away if nobody picks them up. returns false if there
+        // are none.
+        bool popTransferProgress(TransferProgress & progress);
+        TransferStats transferStats() const;
+        void resetTransferStats();
+
+        // live view frames are handed out through a mailbox. a consumer
+        // always gets the newest frame instead of a backlog, sees each frame
+        // once, and keeps its frame safe from being overwritten until it
+        // acquires another one or releases it. the camera owns the consumers;
+        // returns NULL if there is no more room for another one.
+        LiveViewConsumer * addLiveViewConsumer();
+        // returns NULL until the first frame arrives. isNew is set to false
+        // if the consumer has seen this frame before.
+        const LiveViewFrame * acquireLiveViewFrame(LiveViewConsumer * consumer, bool * isNew = NULL);
+        void releaseLiveViewFrame(LiveViewConsumer * consumer);
+        // every consumer, starting with the default one. for their frame counts.
+        const vector<LiveViewConsumer *> & liveViewConsumers() const;
+
+        // the functions below use the default consumer, which is what the
+        // python buffer interface is built on.
+
+        // call this before you start using the frame buffer. it grabs the
+        // newest frame and stamps it so that we can measure how stale frames are.
+        void acquireLiveViewFrame();
+        // call this when you are done with the frame buffer
+        void releaseLiveViewFrame();
+        // get a pointer to the acquired live view frame data. NULL if there isn't any.
         const unsigned char * liveViewFrameBuffer() const;
-        // length in bytes of the live view frame data
+        // length in bytes of the acquired live view frame data
         int liveViewFrameBufferSize() const; 
+        LiveViewFrameInfo liveViewFrameInfo() const;
+
+        const LiveViewStats & liveViewStats() const;
+        void resetLiveViewStats();
+
+        // hand a copy of every live view frame to a decode pool, which can
+        // be shared with other cameras. callback gets the decoded frames in
+        // the order they were grabbed, on one of the pool's threads.
+        // pass a NULL pool to stop decoding.
+        void setLiveViewDecoder(DecodePool * pool, DecodePool::DecodedFrameCallback callback, void * context, int scaleDenominator = 1);
+        // queue depth and decode time of this camera's frames in the decode
+        // pool. returns false if there is no decoder.
+        bool liveViewDecodeStats(DecodePool::ChannelStats & stats) const;
 
         // perform auto focus once right now
         bool autoFocus();
@@ -150,12 +729,17 @@ class Camera
 
         static stringstream * s_err;
         static queue<ErrorMessage> s_errMsgQueue;
+        // the transfer thread reports errors too
+        static Mutex s_errMsgMutex;
         static ErrorLevel s_errorLevel;
 
         class LiveView {
             public:
             static const int c_delay;
-            static const int c_frameBufferSize;
+            // the default consumer counts as one
+            static const int c_maxConsumers;
+            // how many frames can wait in the decode pool before new ones are dropped
+            static const int c_decodeQueueDepth;
             
             enum State {
                 // we don't want live view on.
@@ -168,20 +752,89 @@ class Camera
                 // interupt live view, like taking a picture
                 Paused,
                 // we have requested live view to turn off but it has not complied yet
-                WaitingToStop
+                WaitingToStop,
+                // only used in the transition table, to leave m_desiredNewState alone
+                Unchanged
+            };
+
+            // things that make the state machine move
+            enum Event {
+                // startLiveView() was called
+                StartRequested,
+                // stopLiveView() was called
+                StopRequested,
+                // we are about to take a picture
+                PauseRequested,
+                // the picture is done
+                ResumeRequested,
+                // the camera may have finished switching live view on or off.
+                // we hear about this through the Evf_OutputDevice property
+                // event, whose parameter is bogus, so we check for ourselves.
+                CameraReady,
+                // we waited c_sleepTimeout for the camera to finish switching
+                TimedOut
+            };
+
+            enum Action {
+                NoAction,
+                // ask the camera to start streaming, go to WaitingToStart
+                RequestStart,
+                // ask the camera to stop streaming, go to WaitingToStop
+                RequestStop,
+                // go straight to Off, the camera is already not streaming
+                TurnOff,
+                // finish a pending start or stop if the camera agrees that it is done
+                Arrive,
+                // a pending start or stop took too long. believe whatever the camera says.
+                Recover
+            };
+
+            struct Transition {
+                State state;
+                Event event;
+                Action action;
+                // what to set m_desiredNewState to, or Unchanged
+                State desiredNewState;
             };
 
-            // if you set m_state to either of the Waiting states, you need to also set m_desiredNewState
+            // (state, event) pairs which are not in here are ignored
+            static const Transition c_transitions[];
+            static const int c_transitionCount;
+
+            static const Transition * findTransition(State state, Event event);
+            static const char * stateName(State state);
+            static const char * eventName(Event event);
+
+            // only change m_state through setState so that the metrics stay right.
+            // if you go to either of the Waiting states, you need to also set m_desiredNewState
             State m_state;
             State m_desiredNewState; // what state to try to get to after we're done waiting
 
-            EdsStreamRef m_streamPtr;
+            // when we entered m_state, and up to when its time has been
+            // added to m_stats.timeInState
+            long long m_stateEnteredAt;
+            long long m_stateAccountedAt;
+
+            // true between the shutter and the transfer request of a picture
+            // taken in KeepLiveView mode. frame grabs are skipped meanwhile.
+            bool m_exposing;
+
+            // filled in by grabLiveViewFrame(), read by the consumers
+            Mailbox<LiveViewFrame> m_frames;
+            // sequence number of the last frame grabbed
+            int m_sequence;
+            vector<LiveViewConsumer *> m_consumers;
+            LiveViewConsumer * m_defaultConsumer;
+            // when the default consumer first acquired the frame it holds
+            long long m_defaultAcquireTime;
 
-            // the allocated space we have set aside for frame data
-            unsigned char * m_frameBuffer;
+            LiveViewStats m_stats;
 
             LiveView();
             ~LiveView();
+
+            void setState(State state);
+            void accountTimeInState();
         };
         LiveView * m_liveView;
 
@@ -189,19 +842,244 @@ class Camera
         static const string c_cameraName_40D;
         static const string c_cameraName_7D;
 
+        // added to the name of a picture while it is still downloading
+        static const string c_partialFileExtension;
+        // files at least this big are downloaded through a memory mapping
+        static const long long c_mappedFileSize;
+
         static map<string, CameraModelData> s_modelData;
         static map<float, EdsUInt32> s_exposureCompensationValues;
         static map<EdsUInt32, float> s_exposureCompensationEnumToFloat;
 
         struct TransferItem {
+            // retained for us by queueTransfer()
             EdsBaseRef sdkRef;
             string outFile;
+            bool toMemory;
+            int transfer;
+            // see PendingFrame
+            int frame;
+            // download the thumbnail first
+            bool wantPreview;
+            Checksum::Algorithm checksum;
+            Durability durability;
+            // see setBackupFolders() and setKeepPictureData()
+            vector<string> backupFolders;
+            bool keepData;
+            // see setDerivatives()
+            vector<Derivative> derivatives;
+            // comes from startIngest() and isn't part of a frame
+            bool ingest;
+            // when the camera asked us to download it
+            long long requestTime;
+        };
+
+        struct FinishedTransfer {
+            int transfer;
+            int frame;
+            bool ingest;
+            bool success;
+            CompletedPicture picture;
+            // with GroupCommit, where the file waits to be flushed before
+            // it gets picture.filename
+            string partialFile;
+            // the same for each of picture.copies. empty for those that
+            // failed already.
+            vector<string> partialCopies;
+            long long size;
+            long long requestTime;
+            long long downloadStartTime;
+            long long downloadEndTime;
+            long long finishTime;
         };
 
+        // what the SDK's progress callback needs to know about a download
+        struct ProgressContext {
+            Camera * camera;
+            TransferProgress progress;
+            long long startTime;
+        };
+
+        // how many progress reports we keep for popTransferProgress()
+        static const int c_maxTransferProgress;
+        // how many previews we keep for popPicturePreview()
+        static const int c_maxPicturePreviews;
+        // how many shots a TimelapseReport, and exposures a BulbReport,
+        // keep
+        static const int c_maxReportedShots;
+
         EdsCameraRef m_cam;
 
-        // what file to save the next picture as
-        string m_picOutFile;
+        // where the frames of a shot go
+        struct ShotDestination {
+            // may contain %n, see takeSinglePicture()
+            string outFile;
+            bool toMemory;
+            // how many frames have come in for it
+            int frames;
+            // the drive mode can make more than one frame of it. otherwise
+            // it is done once its first frame is in.
+            bool multipleFrames;
+        };
+
+        // shots which have been taken but haven't sent us a picture yet,
+        // oldest first. SDK thread only.
+        deque<ShotDestination> m_shotDestinations;
+        // the shot we got the last picture for. further frames of it go
+        // to the same place.
+        ShotDestination m_currentShot;
+        bool m_haveCurrentShot;
+
+        struct Burst {
+            // we are holding the shutter button down
+            bool shutterHeld;
+            // pictures are going into report. stays on after we let go of
+            // the button until a picture for some other shot comes in.
+            bool recording;
+            DriveMode previousDriveMode;
+            long long lastFrameTime;
+            BurstReport report;
+
+            Burst() : shutterHeld(false), recording(false), previousDriveMode(SingleFrameShooting), lastFrameTime(0) {}
+        };
+        Burst m_burst;
+
+        // with RAW+JPEG the camera hands us two items per frame, one after
+        // the other. they download separately and are put back together
+        // here before they are handed out. SDK thread only.
+        struct PendingFrame {
+            // how many items the image quality says are coming
+            int expected;
+            // how many have come in so far
+            int arrived;
+            // the first one, which the burst report knows the frame by
+            int transfer;
+            // the shot's outFile with %n filled in, without the extension
+            string outFile;
+            bool toMemory;
+            // items which share a frame share a group id, unless it is 0
+            EdsUInt32 groupID;
+            long long lastArrival;
+            vector<FinishedTransfer> parts;
+        };
+        map<int, PendingFrame> m_pendingFrames;
+        // the frame further items are added to while it is short of items
+        int m_currentFrame;
+        int m_frameCount;
+
+        struct Timelapse {
+            bool running;
+            string nameTemplate;
+            TimelapseBusyPolicy policy;
+            // index of the next deadline, from 0
+            int next;
+            TimelapseReport report;
+
+            Timelapse() : running(false), policy(SkipWhenBusy), next(0) {}
+        };
+        Timelapse m_timelapse;
+
+        struct BulbJob {
+            long long duration;
+            // after this one, before the next
+            long long gap;
+            string outFile;
+        };
+        struct Bulb {
+            deque<BulbJob> queue;
+            // the shutter is open for queue.front()
+            bool exposing;
+            // the body doesn't do BulbStart, so the shutter button is held
+            // instead, like the newer ones want
+            bool useShutterButton;
+            BulbExposure current;
+            // when the close command goes out
+            long long endAt;
+            // when the next one can open
+            long long nextStart;
+            // when the camera first said it was busy for queue.front(), or 0
+            long long busySince;
+            // close commands that failed for the open exposure
+            int closeAttempts;
+            BulbReport report;
+
+            Bulb() : exposing(false), useShutterButton(false), endAt(0), nextStart(0), busySince(0), closeAttempts(0) {}
+        };
+        Bulb m_bulb;
+        // the close command isn't left to a sleep, which can be a whole
+        // timer tick late. this long before it, pollDelay() says 0, so the
+        // SDK thread polls without sleeping, letting go of the GIL in
+        // between.
+        static const long long c_bulbSpin;
+        // how long to wait before asking a busy camera again
+        static const long long c_bulbRetry;
+        // how many times to try closing the shutter before giving up on it
+        static const int c_bulbCloseAttempts;
+
+        // a file or folder on the card
+        struct IngestItem {
+            // we hold a reference to it
+            EdsDirectoryItemRef ref;
+            string name;
+            // from the top of the card, like DCIM/100CANON/IMG_0042.JPG
+            string path;
+            long long size;
+        };
+        struct Ingest {
+            bool running;
+            string folder;
+            int maxInFlight;
+            // checking against m_manifest, see startSync()
+            bool sync;
+            bool fullScan;
+            // handed to the transfer threads and not back yet, by transfer
+            // number. their refs belong to the transfer threads.
+            map<int, IngestItem> inFlight;
+            // waiting to be listed, in order
+            deque<IngestItem> folders;
+            // the folder being listed, c_ingestListBatch children per poll
+            IngestItem listing;
+            bool listingFolder;
+            EdsUInt32 listCount;
+            EdsUInt32 listNext;
+            vector<IngestItem> listedFiles;
+            vector<IngestItem> listedFolders;
+            // listed, sorted, and waiting for room in the transfer queue
+            deque<IngestItem> files;
+            IngestReport report;
+
+            Ingest() : running(false), maxInFlight(0), sync(false), fullScan(false), listingFolder(false), listCount(0), listNext(0) {}
+        };
+        Ingest m_ingest;
+        // guarded by m_pictureDoneMutex
+        deque<CompletedPicture> m_ingestedFiles;
+        // what startSync() has copied from this body. open from then until
+        // disconnect() or startIngest().
+        Manifest m_manifest;
+        // how many children of a folder are listed per poll
+        static const int c_ingestListBatch;
+        // how long pollDelay() lets the SDK thread sleep between batches,
+        // in milliseconds
+        static const int c_ingestListDelay;
+        // how many files we keep for popIngestedFile()
+        static const int c_maxIngestedFiles;
+
+        // when the last shutter command was sent
+        long long m_lastShutterTime;
+
+        // the shutter button is held halfway, see prefocus()
+        bool m_focusHeld;
+        // the last shot whose first picture hasn't been offered yet, for
+        // ShutterLagStats. 0 if there isn't one.
+        long long m_lagShutterTime;
+        bool m_lagPrefocused;
+        ShutterLagStats m_shutterLagStats;
+
+        CaptureLiveViewMode m_captureLiveViewMode;
+
+        // where live view frames get decoded, if anywhere
+        DecodePool * m_decodePool;
+        int m_decodeChannel;
 
         EdsPoint m_zoomPosition;
         bool m_pendingZoomPosition;
@@ -216,9 +1094,84 @@ class Camera
         // how many milliseconds to sleep before doing the event pump
         static const int c_sleepAmount;
 
-        queue<string> m_pictureDoneQueue;
+        queue<CompletedPicture> m_pictureDoneQueue;
+        mutable Mutex m_pictureDoneMutex;
+
+        // pictures are downloaded on their own threads so that event
+        // handling, and the next picture, don't have to wait for them.
+        // two, so that the items of a RAW+JPEG frame can go at the same time.
+        static const int c_transferThreadCount = 2;
+        Thread m_transferThreads[c_transferThreadCount];
+        // one post per item in m_transferQueue, plus one per thread to stop
+        Semaphore m_transferJobs;
+        // guards the transfer queues and m_stopTransfers
+        mutable Mutex m_transferMutex;
+        queue<TransferItem> m_transferQueue;
+        // done downloading, waiting for poll() to hand them out
+        deque<FinishedTransfer> m_finishedTransfers;
+        bool m_stopTransfers;
+        // queued but not handed out by poll() yet. SDK thread only.
+        int m_transfersInFlight;
+        // SDK thread only
+        int m_transferCount;
+        // guarded by m_transferMutex as well
+        deque<TransferProgress> m_transferProgress;
+        TransferStats m_transferStats;
+        // downloaded, waiting for poll() to hand them out
+        deque<PicturePreview> m_newPreviews;
+
+        // flushes the files of GroupCommit downloads in batches
+        Thread m_groupCommitThread;
+        // one post per item in m_unflushedTransfers, plus one to stop
+        Semaphore m_groupCommitJobs;
+        // downloaded and renamed, waiting for the group commit thread.
+        // guarded by m_transferMutex, as are the two below.
+        deque<FinishedTransfer> m_unflushedTransfers;
+        int m_groupCommitInterval;
+        bool m_stopGroupCommit;
+
+        bool m_picturePreviews;
+        // handed out, guarded by m_pictureDoneMutex
+        deque<PicturePreview> m_previewQueue;
+        picturePreviewCallback m_picturePreviewCallback;
 
         takePictureCompleteCallback m_pictureCompleteCallback;
+        takePictureDataCallback m_pictureDataCallback;
+        takePictureDataCallback m_pictureDoneCallback;
+        Checksum::Algorithm m_checksum;
+        // SDK thread only
+        Durability m_durability;
+        vector<string> m_backupFolders;
+        bool m_keepPictureData;
+        vector<Derivative> m_derivatives;
+
+        // a picture that is with the pool, waiting for its derivatives
+        struct PendingDerivatives {
+            string source;
+            vector<Derivative> derivatives;
+            long long savedTime;
+        };
+        // guards the three below. the transfer threads take a copy of them
+        // and let go before they wait for room in the pool, since
+        // setDerivatives() takes it before it closes the channel.
+        Mutex m_derivativeMutex;
+        DecodePool * m_derivativePool;
+        int m_derivativeChannel;
+        int m_derivativeSequence;
+        // the pool's threads take pictures back out of here, so it has a
+        // mutex of its own
+        Mutex m_pendingDerivativesMutex;
+        map<int, PendingDerivatives> m_pendingDerivatives;
+        // guarded by m_pictureDoneMutex
+        deque<DerivativeDone> m_derivativesDone;
+        // pictures with the pool before the transfer threads wait for it
+        static const int c_derivativeQueueDepth;
+
+        // hands the bytes of a picture that was just saved to the pool
+        void queueDerivatives(const string & filename, vector<unsigned char> & data, const vector<Derivative> & derivatives);
+        static void staticMakeDerivatives(DecodePool::DecodedFrame & frame, void * context);
+        void makeDerivatives(DecodePool::DecodedFrame & frame);
+        void derivativeDone(const DerivativeDone & done);
 
         bool m_connected;
 
@@ -242,19 +1195,137 @@ class Camera
 
         string ensureDoesNotExist(string outfile);
 
-        bool transferOneItem(EdsBaseRef inRef, string outFolder);
+        static void transferThread(void * context);
+        void transferLoop();
+        static void groupCommitThread(void * context);
+        void groupCommitLoop();
+        bool startTransferThreads();
+        // finishes the queued transfers first
+        void stopTransferThreads();
+        bool transferThreadsStarted() const;
+        // hand a DirItemRequestTransfer item to the transfer threads.
+        // returns the transfer number, or 0 if it couldn't be queued.
+        // newFrame is set if the item isn't the second half of a RAW+JPEG pair.
+        int queueTransfer(EdsBaseRef inRef, bool & newFrame);
+        // hand out the pictures the transfer threads are done with. SDK thread only.
+        void finishTransfers();
+        // how many items the camera makes per frame at its image quality
+        int itemsPerFrame();
+        // stop waiting for more items of a frame, and hand it out if its
+        // downloads are done
+        void closeFrame(int frame);
+        // hands out the frame if all of its items are downloaded
+        void completeFrame(int frame);
+        // outFile with the extension of the camera's name for the picture
+        static string withCameraExtension(string outFile, const string & cameraFilename);
+
+        // these run on the transfer thread
+        bool transferOneItem(const TransferItem & item, FinishedTransfer & result);
+        bool transferOneItemToMemory(const TransferItem & item, FinishedTransfer & result);
+        // the part they have in common. aborts the sink if it fails.
+        bool downloadItem(const TransferItem & item, const EdsDirectoryItemInfo & dirItemInfo, Sink & sink, FinishedTransfer & result);
+        void downloadPreview(const TransferItem & item);
+        // for when the checksum couldn't be done on the way in
+        static string checksumOfFile(const string & filename, Checksum::Algorithm algorithm);
+        // have the SDK report how the download into stream is going
+        void watchProgress(EdsStreamRef stream, ProgressContext & context);
+        static EdsError EDSCALLBACK staticProgressCallback(EdsUInt32 inPercent, EdsVoid * inContext, EdsBool * outCancel);
+        void reportProgress(const TransferProgress & progress);
+        bool takePicture(string outFile, bool toMemory);
+        // the camera offered the first picture of the last shot
+        void shutterLagPictureArrived(long long now);
+        // gets live view and the destination ready for a shot
+        bool beginShot(string outFile, bool toMemory);
+        // undoes beginShot() if the shutter command failed
+        void abandonShot();
+
+        void burstFrameArrived(int transfer, long long captureTime);
+        void burstFrameTransferred(int transfer, long long transferTime, const string & filename);
+        // let go of the shutter button and put the drive mode back
+        void releaseBurst();
+        // lets go of the shutter if the camera stops sending frames
+        void checkBurstTimeout();
+        // where the picture the camera is handing us goes. returns true if
+        // it is the first picture of a shot.
+        bool nextPictureDestination(string & outFile, bool & toMemory);
+        static string expandNameTemplate(string nameTemplate, int frame);
+        // adds _%n before the extension if there isn't a %n already
+        static string addFrameNumber(string nameTemplate);
+
+        // takes the timelapse shot that has come due, if any
+        void checkTimelapse();
+        long long timelapseDeadline(int index) const;
+        void recordTimelapseShot(TimelapseShot & shot);
+        bool queueBulbExposures(int count, int durationMs, int gapMs, string outFile, bool numbered);
+        // opens the shutter for the next exposure, or closes it, when due
+        void checkBulb();
+        void startBulb();
+        // without retry a failed close is given up on right away, instead
+        // of being tried again from poll()
+        void endBulb(bool retry = true);
+        void recordBulbExposure(BulbExposure & exposure);
+        // when poll() next has bulb work, or 0
+        long long bulbDeadline() const;
+        // a picture is still being exposed or downloaded
+        bool captureInFlight() const;
+        bool beginIngest(string folder, int maxInFlight, bool sync, bool fullScan);
+        // hands the transfer threads more of the card, and lists more of it
+        void checkIngest();
+        void listIngestFolder();
+        void queueIngestFile(const IngestItem & file);
+        // the transfer thread is done with a file of the ingest
+        void ingestFileDone(FinishedTransfer & transfer);
+        // ends the ingest if nothing is left to list, queue, or download
+        void finishIngestIfDone();
+        // oldest first, going by the DCF file number
+        static bool ingestOrder(const IngestItem & a, const IngestItem & b);
+        static bool ingestFolderOrder(const IngestItem & a, const IngestItem & b);
+        // the number at the end of a DCF file name, like 1234 for
+        // IMG_1234.JPG. -1 if there isn't one.
+        static int dcfFileNumber(const string & name);
+        // the camera wrote a new file to the card
+        void dirItemCreated(EdsDirectoryItemRef item);
+        // see IngestItem::path
+        static string cardPath(EdsDirectoryItemRef item);
+        // whether the manifest has the file. readCard says whether the
+        // start of the file had to be read to tell, see Manifest::Entry::taken.
+        bool alreadySynced(const IngestItem & file, bool & readCard);
+        // Manifest::Entry::taken from the metadata, or empty
+        static string takenTime(const Exif::Metadata & metadata);
+        // the same, from the start of a file on the card
+        static string takenTime(EdsDirectoryItemRef item, long long size);
+        // how much of a file takenTime() reads. a multiple of 512, which
+        // the SDK wants when it downloads a file in pieces.
+        static const int c_takenTimeReadSize;
+        // the serial number of the body, which names its manifest
+        string bodyID();
+        // everything that happens once a picture is off the camera
+        void pictureDone(CompletedPicture & picture);
+        void previewDone(PicturePreview & preview);
         bool setComputerCapabilities();
 
         bool pauseLiveView();
         bool resumeLiveView();
 
+        // runs the live view transition table. returns false if talking to
+        // the camera failed.
+        bool handleLiveViewEvent(LiveView::Event event);
+        // carries out a LiveView::Arrive or LiveView::Recover action
+        bool finishLiveViewTransition(bool timedOut);
+        // fires LiveView::TimedOut if a start or stop has been pending too long
+        void checkLiveViewTimeout();
+
+        // decides whether the next capture can leave live view running
+        bool keepLiveViewForCapture() const;
+        void endExposure();
+
         static void pushErrMsg(ErrorLevel level = Error);
+        // for threads other than the SDK one, which must leave s_err alone
+        static void pushErrMsg(ErrorLevel level, const string & message);
 
         bool _startLiveView();
         bool _stopLiveView();
 
-        void handleCameraIsReady();
-
         // name of the camera model
         string getName() const;
 
@@ -1,13 +1,37 @@
 #include <Python.h>
 
 #include "Camera.h"
+#include "DecodePool.h"
+#include "Threading.h"
 
 extern "C" {
     static PyObject * CameraError;
 
+    // decodes live view frames for every camera that asks for it.
+    // created the first time somebody does.
+    static DecodePool * s_decodePool = NULL;
+    // makes derivatives for every camera that asks for them. a pool of its
+    // own, so that full size pictures don't queue up in front of live view
+    // frames, and below normal priority, so that its threads give the
+    // cores to live view when both want them.
+    static DecodePool * s_derivativePool = NULL;
+
+    // the newest decoded live view frame of a camera
+    struct DecodedLiveView {
+        // the decode pool writes from its own threads
+        Mutex mutex;
+        bool available;
+        int sequence;
+        Jpeg::Image image;
+
+        DecodedLiveView() : available(false), sequence(0) {}
+    };
+
     typedef struct {
         PyObject_HEAD
         Camera * camera; // C++ object
+        int exports; // how many buffers are looking at the live view frame
+        DecodedLiveView * decoded;
     } CameraObject;
 
     static void Camera_dealloc(CameraObject * self);
@@ -23,6 +47,16 @@ extern "C" {
     
     static PyObject * Camera_name(CameraObject * self, PyObject * args);
     static PyObject * Camera_takeSinglePicture(CameraObject * self, PyObject * args);
+    static PyObject * Camera_takeSinglePictureToMemory(CameraObject * self, PyObject * args);
+    static PyObject * Camera_prefocus(CameraObject * self, PyObject * args);
+    static PyObject * Camera_takePrefocusedPicture(CameraObject * self, PyObject * args);
+    static PyObject * Camera_releaseFocus(CameraObject * self, PyObject * args);
+    static PyObject * Camera_focusHeld(CameraObject * self, PyObject * args);
+    static PyObject * Camera_shutterLagStats(CameraObject * self, PyObject * args);
+    static PyObject * Camera_resetShutterLagStats(CameraObject * self, PyObject * args);
+    static PyObject * Camera_takeBurst(CameraObject * self, PyObject * args);
+    static PyObject * Camera_burstInProgress(CameraObject * self, PyObject * args);
+    static PyObject * Camera_lastBurst(CameraObject * self, PyObject * args);
     static PyObject * Camera_startLiveView(CameraObject * self, PyObject * args);
     static PyObject * Camera_stopLiveView(CameraObject * self, PyObject * args);
     static PyObject * Camera_zoomRatio(CameraObject * self, PyObject * args);
@@ -39,7 +73,19 @@ extern "C" {
     static PyObject * Camera_setExposureCompensation(CameraObject * self, PyObject * args);
 
     static PyObject * Camera_popPictureDoneQueue(CameraObject * self, PyObject * args);
+    static PyObject * Camera_popCompletedPicture(CameraObject * self, PyObject * args);
     static PyObject * Camera_pictureDoneQueueSize(CameraObject * self, PyObject * args);
+    static PyObject * Camera_popTransferProgress(CameraObject * self, PyObject * args);
+    static PyObject * Camera_setPicturePreviews(CameraObject * self, PyObject * args);
+    static PyObject * Camera_setChecksum(CameraObject * self, PyObject * args);
+    static PyObject * Camera_setDurability(CameraObject * self, PyObject * args);
+    static PyObject * Camera_setBackupFolders(CameraObject * self, PyObject * args);
+    static PyObject * Camera_setKeepPictureData(CameraObject * self, PyObject * args);
+    static PyObject * Camera_setDerivatives(CameraObject * self, PyObject * args);
+    static PyObject * Camera_popDerivative(CameraObject * self, PyObject * args);
+    static PyObject * Camera_popPicturePreview(CameraObject * self, PyObject * args);
+    static PyObject * Camera_transferStats(CameraObject * self, PyObject * args);
+    static PyObject * Camera_resetTransferStats(CameraObject * self, PyObject * args);
     static PyObject * Camera_grabLiveViewFrame(CameraObject * self, PyObject * args);
     static PyObject * Camera_autoFocus(CameraObject * self, PyObject * args);
 
@@ -48,14 +94,70 @@ extern "C" {
     static PyObject * Camera_zoomBoxSize(CameraObject * self, PyObject * args);
     static PyObject * Camera_zoomPosition(CameraObject * self, PyObject * args);
     static PyObject * Camera_setZoomPosition(CameraObject * self, PyObject * args);
+
+    static PyObject * Camera_liveViewFrameInfo(CameraObject * self, PyObject * args);
+    static PyObject * Camera_liveViewStats(CameraObject * self, PyObject * args);
+    static PyObject * Camera_resetLiveViewStats(CameraObject * self, PyObject * args);
+    static PyObject * Camera_captureLiveViewMode(CameraObject * self, PyObject * args);
+    static PyObject * Camera_setCaptureLiveViewMode(CameraObject * self, PyObject * args);
+    static PyObject * Camera_liveViewState(CameraObject * self, PyObject * args);
+    static PyObject * Camera_poll(CameraObject * self, PyObject * args);
+    static PyObject * Camera_pollDelay(CameraObject * self, PyObject * args);
+    static PyObject * Camera_startTimelapse(CameraObject * self, PyObject * args);
+    static PyObject * Camera_stopTimelapse(CameraObject * self, PyObject * args);
+    static PyObject * Camera_timelapseRunning(CameraObject * self, PyObject * args);
+    static PyObject * Camera_startIngest(CameraObject * self, PyObject * args);
+    static PyObject * Camera_startSync(CameraObject * self, PyObject * args);
+    static PyObject * Camera_stopIngest(CameraObject * self, PyObject * args);
+    static PyObject * Camera_ingestRunning(CameraObject * self, PyObject * args);
+    static PyObject * Camera_ingestReport(CameraObject * self, PyObject * args);
+    static PyObject * Camera_popIngestedFile(CameraObject * self, PyObject * args);
+    static PyObject * Camera_timelapseReport(CameraObject * self, PyObject * args);
+    static PyObject * Camera_takeBulbExposure(CameraObject * self, PyObject * args);
+    static PyObject * Camera_takeBulbSequence(CameraObject * self, PyObject * args);
+    static PyObject * Camera_cancelBulb(CameraObject * self, PyObject * args);
+    static PyObject * Camera_bulbInProgress(CameraObject * self, PyObject * args);
+    static PyObject * Camera_bulbReport(CameraObject * self, PyObject * args);
+    static PyObject * Camera_enableLiveViewDecode(CameraObject * self, PyObject * args);
+    static PyObject * Camera_disableLiveViewDecode(CameraObject * self, PyObject * args);
+    static PyObject * Camera_decodedLiveViewFrame(CameraObject * self, PyObject * args);
+    static PyObject * Camera_liveViewDecodeStats(CameraObject * self, PyObject * args);
     static PyMethodDef CameraMethods[] = {
         {"connect",             (PyCFunction)Camera_connect,             METH_VARARGS, "establish a session on the camera"},
         {"disconnect",          (PyCFunction)Camera_disconnect,          METH_VARARGS, "release the session with the camera"},
 
         {"name",                (PyCFunction)Camera_name,                METH_VARARGS, "Return the model name of the camera"},
         {"takeSinglePicture",   (PyCFunction)Camera_takeSinglePicture,   METH_VARARGS, "takes one picture to file specified."},
+        {"takeSinglePictureToMemory",(PyCFunction)Camera_takeSinglePictureToMemory,METH_VARARGS, "takes one picture and keeps it in memory instead of writing a file."},
+        {"prefocus",            (PyCFunction)Camera_prefocus,            METH_VARARGS, "holds the shutter button halfway so the camera focuses and meters ahead of time."},
+        {"takePrefocusedPicture",(PyCFunction)Camera_takePrefocusedPicture,METH_VARARGS, "takes one picture to the file specified without focusing again. (outFile, keepHolding)"},
+        {"releaseFocus",        (PyCFunction)Camera_releaseFocus,        METH_VARARGS, "lets go of the half pressed shutter button."},
+        {"focusHeld",           (PyCFunction)Camera_focusHeld,           METH_VARARGS, "whether the shutter button is held halfway."},
+        {"shutterLagStats",     (PyCFunction)Camera_shutterLagStats,     METH_VARARGS, "histograms of shutter lag with and without prefocus."},
+        {"resetShutterLagStats",(PyCFunction)Camera_resetShutterLagStats,METH_VARARGS, "clears the shutter lag histograms."},
+        {"takeBurst",           (PyCFunction)Camera_takeBurst,           METH_VARARGS, "holds the shutter down for (count, nameTemplate[, driveMode]) pictures."},
+        {"burstInProgress",     (PyCFunction)Camera_burstInProgress,     METH_VARARGS, "returns whether the shutter is still held down for a burst."},
+        {"lastBurst",           (PyCFunction)Camera_lastBurst,           METH_VARARGS, "returns a dict of timings of the most recent burst."},
         {"startLiveView",       (PyCFunction)Camera_startLiveView,       METH_VARARGS, "tells the camera to go into live view mode"},
         {"stopLiveView",        (PyCFunction)Camera_stopLiveView,        METH_VARARGS, "tells the camera to come out of live view mode"},
+        {"liveViewState",       (PyCFunction)Camera_liveViewState,       METH_VARARGS, "returns the name of the state live view is in"},
+        {"poll",                (PyCFunction)Camera_poll,                METH_VARARGS, "does time based housekeeping. call regularly from the SDK thread."},
+        {"pollDelay",           (PyCFunction)Camera_pollDelay,           METH_VARARGS, "returns how many milliseconds, at most the one given, until poll has scheduled work."},
+        {"startTimelapse",      (PyCFunction)Camera_startTimelapse,      METH_VARARGS, "takes (intervalMs, count, nameTemplate[, skipWhenBusy]) pictures on a fixed schedule."},
+        {"stopTimelapse",       (PyCFunction)Camera_stopTimelapse,       METH_VARARGS, "stops the running timelapse."},
+        {"timelapseRunning",    (PyCFunction)Camera_timelapseRunning,    METH_VARARGS, "returns whether a timelapse is running."},
+        {"startIngest",         (PyCFunction)Camera_startIngest,         METH_VARARGS, "copies (folder[, maxInFlight]) every picture on the camera's cards into folder."},
+        {"startSync",           (PyCFunction)Camera_startSync,           METH_VARARGS, "copies (folder[, maxInFlight, fullScan]) the pictures on the camera's cards that folder's manifest doesn't have yet."},
+        {"stopIngest",          (PyCFunction)Camera_stopIngest,          METH_VARARGS, "stops the running ingest."},
+        {"ingestRunning",       (PyCFunction)Camera_ingestRunning,       METH_VARARGS, "returns whether an ingest is running."},
+        {"ingestReport",        (PyCFunction)Camera_ingestReport,        METH_VARARGS, "returns a dict with how the ingest is going."},
+        {"popIngestedFile",     (PyCFunction)Camera_popIngestedFile,     METH_VARARGS, "returns a dict for the next file the ingest copied, or None."},
+        {"timelapseReport",     (PyCFunction)Camera_timelapseReport,     METH_VARARGS, "returns a dict of every shot of the last timelapse and its jitter."},
+        {"takeBulbExposure",    (PyCFunction)Camera_takeBulbExposure,    METH_VARARGS, "holds the shutter open (durationMs, outFile) in bulb mode."},
+        {"takeBulbSequence",    (PyCFunction)Camera_takeBulbSequence,    METH_VARARGS, "queues (count, durationMs, gapMs, nameTemplate) bulb exposures."},
+        {"cancelBulb",          (PyCFunction)Camera_cancelBulb,          METH_VARARGS, "closes the shutter and drops the queued bulb exposures."},
+        {"bulbInProgress",      (PyCFunction)Camera_bulbInProgress,      METH_VARARGS, "whether a bulb exposure is open or queued."},
+        {"bulbReport",          (PyCFunction)Camera_bulbReport,          METH_VARARGS, "returns a dict of every bulb exposure and how long it really was."},
         {"autoFocus",           (PyCFunction)Camera_autoFocus,           METH_VARARGS, "performs an auto focus once right now"},
 
         {"liveViewImageSize",   (PyCFunction)Camera_liveViewImageSize,   METH_VARARGS, "returns (w, h) of the image data coming from live view."},
@@ -78,8 +180,29 @@ extern "C" {
         {"setExposureCompensation",(PyCFunction)Camera_setExposureCompensation,METH_VARARGS, "sets the exposure compensation property"},
 
         {"popPictureDoneQueue", (PyCFunction)Camera_popPictureDoneQueue, METH_VARARGS, "pops the oldest picture that is completed."},
+        {"popCompletedPicture", (PyCFunction)Camera_popCompletedPicture, METH_VARARGS, "pops the oldest completed picture as a dict with filename, cameraFilename and data, or None."},
         {"pictureDoneQueueSize",(PyCFunction)Camera_pictureDoneQueueSize,METH_VARARGS, "checks how many pictures are in the completed queue."},
+        {"popTransferProgress", (PyCFunction)Camera_popTransferProgress, METH_VARARGS, "pops the oldest picture download progress report as a dict, or None."},
+        {"setPicturePreviews",  (PyCFunction)Camera_setPicturePreviews,  METH_VARARGS, "turns downloading the thumbnail of every picture first on or off."},
+        {"setChecksum",         (PyCFunction)Camera_setChecksum,         METH_VARARGS, "checksums pictures as they download with 'none', 'crc32c' or 'sha256'."},
+        {"setDurability",       (PyCFunction)Camera_setDurability,       METH_VARARGS, "flushes pictures to disk with 'none', 'file' or 'group', and the group commit interval in milliseconds."},
+        {"setBackupFolders",    (PyCFunction)Camera_setBackupFolders,    METH_VARARGS, "writes every picture into each folder of a list as well."},
+        {"setKeepPictureData",  (PyCFunction)Camera_setKeepPictureData,  METH_VARARGS, "keeps the bytes of pictures that go to a file as well."},
+        {"setDerivatives",      (PyCFunction)Camera_setDerivatives,      METH_VARARGS, "writes resized copies of every JPEG, given a list of (name, maxSize, quality)."},
+        {"popDerivative",       (PyCFunction)Camera_popDerivative,       METH_VARARGS, "pops the oldest finished derivative as a dict, or None."},
+        {"popPicturePreview",   (PyCFunction)Camera_popPicturePreview,   METH_VARARGS, "pops the oldest picture preview as a dict, or None."},
+        {"transferStats",       (PyCFunction)Camera_transferStats,       METH_VARARGS, "returns a dict of picture download counters and timing and throughput histograms."},
+        {"resetTransferStats",  (PyCFunction)Camera_resetTransferStats,  METH_VARARGS, "clears the picture download counters and histograms."},
         {"grabLiveViewFrame",   (PyCFunction)Camera_grabLiveViewFrame,   METH_VARARGS, "refresh the frame buffer with a new frame from the camera."},
+        {"liveViewFrameInfo",   (PyCFunction)Camera_liveViewFrameInfo,   METH_VARARGS, "returns (sequence, request, download, acquire) times in microseconds of the current frame."},
+        {"liveViewStats",       (PyCFunction)Camera_liveViewStats,       METH_VARARGS, "returns a dict of live view frame counters and latency histograms."},
+        {"resetLiveViewStats",  (PyCFunction)Camera_resetLiveViewStats,  METH_VARARGS, "clears the live view frame counters and latency histograms."},
+        {"captureLiveViewMode", (PyCFunction)Camera_captureLiveViewMode, METH_VARARGS, "returns what happens to live view when taking a picture"},
+        {"setCaptureLiveViewMode",(PyCFunction)Camera_setCaptureLiveViewMode,METH_VARARGS, "sets what happens to live view when taking a picture"},
+        {"enableLiveViewDecode",(PyCFunction)Camera_enableLiveViewDecode,METH_VARARGS, "decode every live view frame on the shared decode pool, scaled down by 1, 2, 4 or 8"},
+        {"disableLiveViewDecode",(PyCFunction)Camera_disableLiveViewDecode,METH_VARARGS, "stop decoding live view frames"},
+        {"decodedLiveViewFrame",(PyCFunction)Camera_decodedLiveViewFrame,METH_VARARGS, "returns (sequence, width, height, rgb bytes) of the newest decoded frame, or None"},
+        {"liveViewDecodeStats", (PyCFunction)Camera_liveViewDecodeStats, METH_VARARGS, "returns a dict of decode pool counters, queue depth and timings for this camera, or None"},
 
         {NULL, NULL, 0, NULL} // sentinel
     };
@@ -124,11 +247,191 @@ extern "C" {
 
 #define CameraObject_Check(v) ((v)->ob_type == &Camera_Type)
 
+    // helpers
+
+    // None if there isn't one
+    static PyObject * checksumObject(const string & checksum)
+    {
+        if (checksum.empty())
+            Py_RETURN_NONE;
+        return PyUnicode_FromString(checksum.c_str());
+    }
+
+    // a list of {filename, success, error}. error is None if it worked.
+    static PyObject * copiesToList(const vector<Camera::PictureCopy> & copies)
+    {
+        PyObject * list = PyList_New(0);
+        if (list == NULL)
+            return NULL;
+
+        for (unsigned int i = 0; i < copies.size(); i++) {
+            const Camera::PictureCopy & copy = copies[i];
+            PyObject * error;
+            if (copy.success) {
+                error = Py_None;
+                Py_INCREF(error);
+            } else {
+                error = PyUnicode_FromString(copy.error.c_str());
+            }
+            PyObject * item = error == NULL ? NULL : Py_BuildValue("{s:s,s:O,s:N}",
+                "filename", copy.filename.c_str(),
+                "success", copy.success ? Py_True : Py_False,
+                "error", error);
+            if (item == NULL || PyList_Append(list, item) != 0) {
+                Py_XDECREF(item);
+                Py_DECREF(list);
+                return NULL;
+            }
+            Py_DECREF(item);
+        }
+        return list;
+    }
+
+    // EXIF strings are meant to be ASCII, but whatever a camera puts in
+    // them shouldn't make the whole dict fail
+    static PyObject * exifString(const char * value)
+    {
+        return PyUnicode_DecodeLatin1(value, strlen(value), "replace");
+    }
+
+    // None if the file had no EXIF in it
+    static PyObject * metadataToDict(const Exif::Metadata & metadata)
+    {
+        if (! metadata.valid)
+            Py_RETURN_NONE;
+
+        const char * strings[] = {metadata.make, metadata.model, metadata.serialNumber,
+            metadata.lensModel, metadata.dateTimeOriginal, metadata.subSecTimeOriginal};
+        const int stringCount = sizeof(strings) / sizeof(strings[0]);
+        PyObject * values[stringCount];
+        bool failed = false;
+        for (int i = 0; i < stringCount; i++) {
+            values[i] = exifString(strings[i]);
+            failed = failed || values[i] == NULL;
+        }
+        if (failed) {
+            for (int i = 0; i < stringCount; i++)
+                Py_XDECREF(values[i]);
+            return NULL;
+        }
+
+        return Py_BuildValue("{s:N,s:N,s:N,s:N,s:N,s:N,s:(II),s:d,s:d,s:I,s:d,s:d,s:i,s:i,s:i,s:i}",
+            "make", values[0],
+            "model", values[1],
+            "serialNumber", values[2],
+            "lensModel", values[3],
+            "dateTimeOriginal", values[4],
+            "subSecTimeOriginal", values[5],
+            "exposureFraction", metadata.exposureNumerator, metadata.exposureDenominator,
+            "exposureTime", metadata.exposureTime,
+            "fNumber", metadata.fNumber,
+            "iso", metadata.iso,
+            "exposureBias", metadata.exposureBias,
+            "focalLength", metadata.focalLength,
+            "orientation", metadata.orientation,
+            "flash", metadata.flash,
+            "width", metadata.width,
+            "height", metadata.height);
+    }
+
+    // one file of a picture. filename is None if it is in memory, and data
+    // is None if it is on disk, unless its bytes were kept as well.
+    static PyObject * pictureFileToDict(const string & filename, const string & cameraFilename,
+        const vector<unsigned char> & data, const string & checksum, Camera::Durability durability,
+        const vector<Camera::PictureCopy> & copies, const Exif::Metadata & metadata)
+    {
+        PyObject * filenameObject;
+        if (filename.empty()) {
+            filenameObject = Py_None;
+            Py_INCREF(filenameObject);
+        } else {
+            filenameObject = PyUnicode_FromString(filename.c_str());
+        }
+
+        PyObject * dataObject;
+        if (filename.empty() || ! data.empty()) {
+            dataObject = PyBytes_FromStringAndSize(data.empty() ? "" : (const char *) &data[0], data.size());
+        } else {
+            dataObject = Py_None;
+            Py_INCREF(dataObject);
+        }
+
+        PyObject * checksumValue = checksumObject(checksum);
+        PyObject * copiesValue = copiesToList(copies);
+        PyObject * metadataValue = metadataToDict(metadata);
+        if (filenameObject == NULL || dataObject == NULL || checksumValue == NULL || copiesValue == NULL
+            || metadataValue == NULL)
+        {
+            Py_XDECREF(filenameObject);
+            Py_XDECREF(dataObject);
+            Py_XDECREF(checksumValue);
+            Py_XDECREF(copiesValue);
+            Py_XDECREF(metadataValue);
+            return NULL;
+        }
+
+        return Py_BuildValue("{s:N,s:s,s:N,s:N,s:s,s:N,s:N}",
+            "filename", filenameObject,
+            "cameraFilename", cameraFilename.c_str(),
+            "data", dataObject,
+            "checksum", checksumValue,
+            "durability", Camera::durabilityName(durability),
+            "copies", copiesValue,
+            "metadata", metadataValue);
+    }
+
+    static PyObject * histogramToDict(const Histogram & histogram)
+    {
+        PyObject * buckets = PyList_New(0);
+        if (buckets == NULL)
+            return NULL;
+
+        // leave off the empty buckets at the end
+        int last = Histogram::c_bucketCount - 1;
+        while (last >= 0 && histogram.bucket(last) == 0)
+            --last;
+        for (int i = 0; i <= last; i++) {
+            PyObject * item = Py_BuildValue("(L,L)", Histogram::bucketUpperBound(i), histogram.bucket(i));
+            if (item == NULL || PyList_Append(buckets, item) != 0) {
+                Py_XDECREF(item);
+                Py_DECREF(buckets);
+                return NULL;
+            }
+            Py_DECREF(item);
+        }
+
+        return Py_BuildValue("{s:L,s:L,s:L,s:d,s:L,s:L,s:L,s:N}",
+            "count", histogram.count(),
+            "min", histogram.minimum(),
+            "max", histogram.maximum(),
+            "mean", histogram.mean(),
+            "p50", histogram.percentile(0.50),
+            "p90", histogram.percentile(0.90),
+            "p99", histogram.percentile(0.99),
+            "buckets", buckets);
+    }
+
+    // called by the decode pool on one of its threads. no python in here.
+    static void storeDecodedFrame(const DecodePool::DecodedFrame & frame, void * context)
+    {
+        if (! frame.success)
+            return;
+
+        DecodedLiveView * decoded = (DecodedLiveView *) context;
+        Lock lock(decoded->mutex);
+        decoded->available = true;
+        decoded->sequence = frame.sequence;
+        decoded->image = frame.image;
+    }
+
     // Camera methods
 
     static void Camera_dealloc(CameraObject * self)
     {
+        // the camera closes its decode channel, after which nobody writes
+        // to decoded anymore
         delete self->camera;
+        delete self->decoded;
         PyObject_FREE(self);
     }
 
@@ -174,6 +477,147 @@ extern "C" {
             Py_RETURN_FALSE;
     }
 
+    static PyObject * Camera_takeSinglePictureToMemory(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        if (self->camera->takeSinglePictureToMemory())
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_prefocus(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        if (self->camera->prefocus())
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_takePrefocusedPicture(CameraObject * self, PyObject * args)
+    {
+        char * outFile;
+        int keepHolding = 0;
+        if (! PyArg_ParseTuple(args, "s|i", &outFile, &keepHolding))
+            return NULL;
+
+        if (self->camera->takePrefocusedPicture(outFile, keepHolding != 0))
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_releaseFocus(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        self->camera->releaseFocus();
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_focusHeld(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        if (self->camera->focusHeld())
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_shutterLagStats(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::ShutterLagStats stats = self->camera->shutterLagStats();
+
+        return Py_BuildValue("{s:N,s:N,s:N,s:N,s:N}",
+            "prefocusCommand", histogramToDict(stats.prefocusCommand),
+            "takePictureCommand", histogramToDict(stats.takePictureCommand),
+            "prefocusedCommand", histogramToDict(stats.prefocusedCommand),
+            "takePictureToRequest", histogramToDict(stats.takePictureToRequest),
+            "prefocusedToRequest", histogramToDict(stats.prefocusedToRequest));
+    }
+
+    static PyObject * Camera_resetShutterLagStats(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        self->camera->resetShutterLagStats();
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_takeBurst(CameraObject * self, PyObject * args)
+    {
+        int count;
+        char * nameTemplate;
+        int mode = Camera::HighSpeedContinuousShooting;
+        if (! PyArg_ParseTuple(args, "is|i", &count, &nameTemplate, &mode))
+            return NULL;
+
+        if (self->camera->takeBurst(count, nameTemplate, (Camera::DriveMode)mode))
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_burstInProgress(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        if (self->camera->burstInProgress())
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_lastBurst(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::BurstReport report = self->camera->lastBurst();
+
+        PyObject * frames = PyList_New(0);
+        if (frames == NULL)
+            return NULL;
+        for (unsigned int i = 0; i < report.frames.size(); i++) {
+            const Camera::BurstFrame & frame = report.frames[i];
+            PyObject * item = Py_BuildValue("{s:i,s:i,s:L,s:L,s:s}",
+                "frame", frame.frame,
+                "transfer", frame.transfer,
+                "captureTime", frame.captureTime,
+                "transferTime", frame.transferTime,
+                "filename", frame.filename.c_str());
+            if (item == NULL || PyList_Append(frames, item) != 0) {
+                Py_XDECREF(item);
+                Py_DECREF(frames);
+                return NULL;
+            }
+            Py_DECREF(item);
+        }
+
+        return Py_BuildValue("{s:i,s:L,s:L,s:d,s:d,s:N}",
+            "requested", report.requested,
+            "pressTime", report.pressTime,
+            "releaseTime", report.releaseTime,
+            "captureFps", report.captureFps,
+            "transferFps", report.transferFps,
+            "frames", frames);
+    }
+
     static PyObject * Camera_startLiveView(CameraObject * self, PyObject * args)
     {
         if (! PyArg_ParseTuple(args, ""))
@@ -196,6 +640,281 @@ extern "C" {
             Py_RETURN_FALSE;
     }
 
+    static PyObject * Camera_liveViewState(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        return Py_BuildValue("s", self->camera->liveViewState().c_str());
+    }
+
+    static PyObject * Camera_poll(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        self->camera->poll();
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_pollDelay(CameraObject * self, PyObject * args)
+    {
+        int maxDelay;
+        if (! PyArg_ParseTuple(args, "i", &maxDelay))
+            return NULL;
+
+        return Py_BuildValue("i", self->camera->pollDelay(maxDelay));
+    }
+
+    static PyObject * Camera_startTimelapse(CameraObject * self, PyObject * args)
+    {
+        int intervalMs;
+        int count;
+        char * nameTemplate;
+        int skipWhenBusy = 1;
+        if (! PyArg_ParseTuple(args, "iis|i", &intervalMs, &count, &nameTemplate, &skipWhenBusy))
+            return NULL;
+
+        Camera::TimelapseBusyPolicy policy = skipWhenBusy ? Camera::SkipWhenBusy : Camera::ShootWhenBusy;
+        if (self->camera->startTimelapse(intervalMs, count, nameTemplate, policy))
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_stopTimelapse(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        self->camera->stopTimelapse();
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_timelapseRunning(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        if (self->camera->timelapseRunning())
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_startIngest(CameraObject * self, PyObject * args)
+    {
+        char * folder;
+        int maxInFlight = 4;
+        if (! PyArg_ParseTuple(args, "s|i", &folder, &maxInFlight))
+            return NULL;
+
+        if (self->camera->startIngest(folder, maxInFlight))
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_startSync(CameraObject * self, PyObject * args)
+    {
+        char * folder;
+        int maxInFlight = 4;
+        int fullScan = 0;
+        if (! PyArg_ParseTuple(args, "s|ii", &folder, &maxInFlight, &fullScan))
+            return NULL;
+
+        if (self->camera->startSync(folder, maxInFlight, fullScan != 0))
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_stopIngest(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        self->camera->stopIngest();
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_ingestRunning(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        if (self->camera->ingestRunning())
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_ingestReport(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::IngestReport report = self->camera->ingestReport();
+
+        return Py_BuildValue("{s:O,s:i,s:L,s:i,s:i,s:i,s:L,s:L,s:L,s:d}",
+            "running", report.running ? Py_True : Py_False,
+            "found", report.found,
+            "bytesFound", report.bytesFound,
+            "copied", report.copied,
+            "failed", report.failed,
+            "alreadyCopied", report.alreadyCopied,
+            "bytesCopied", report.bytesCopied,
+            "startTime", report.startTime,
+            "endTime", report.endTime,
+            "megabytesPerSecond", report.megabytesPerSecond);
+    }
+
+    static PyObject * Camera_popIngestedFile(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::CompletedPicture file;
+        if (! self->camera->popIngestedFile(file))
+            Py_RETURN_NONE;
+
+        return pictureFileToDict(file.filename, file.cameraFilename, file.data,
+            file.checksum, file.durability, file.copies, file.metadata);
+    }
+
+    static PyObject * Camera_timelapseReport(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::TimelapseReport report = self->camera->timelapseReport();
+
+        PyObject * shots = PyList_New(0);
+        if (shots == NULL)
+            return NULL;
+        for (unsigned int i = 0; i < report.shots.size(); i++) {
+            const Camera::TimelapseShot & shot = report.shots[i];
+            PyObject * item = Py_BuildValue("{s:i,s:s,s:L,s:L,s:L,s:O,s:s}",
+                "shot", shot.shot,
+                "status", Camera::timelapseShotStatusName(shot.status),
+                "deadline", shot.deadline,
+                "fireTime", shot.fireTime,
+                "jitter", shot.jitter,
+                "overlapped", shot.overlapped ? Py_True : Py_False,
+                "filename", shot.filename.c_str());
+            if (item == NULL || PyList_Append(shots, item) != 0) {
+                Py_XDECREF(item);
+                Py_DECREF(shots);
+                return NULL;
+            }
+            Py_DECREF(item);
+        }
+
+        return Py_BuildValue("{s:L,s:i,s:L,s:i,s:i,s:i,s:i,s:i,s:N,s:N}",
+            "interval", report.interval,
+            "requested", report.requested,
+            "startTime", report.startTime,
+            "taken", report.taken,
+            "failed", report.failed,
+            "skippedBusy", report.skippedBusy,
+            "missed", report.missed,
+            "overlapped", report.overlapped,
+            "jitter", histogramToDict(report.jitter),
+            "shots", shots);
+    }
+
+    static PyObject * Camera_takeBulbExposure(CameraObject * self, PyObject * args)
+    {
+        int durationMs;
+        char * outFile;
+        if (! PyArg_ParseTuple(args, "is", &durationMs, &outFile))
+            return NULL;
+
+        if (self->camera->takeBulbExposure(durationMs, outFile))
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_takeBulbSequence(CameraObject * self, PyObject * args)
+    {
+        int count;
+        int durationMs;
+        int gapMs;
+        char * nameTemplate;
+        if (! PyArg_ParseTuple(args, "iiis", &count, &durationMs, &gapMs, &nameTemplate))
+            return NULL;
+
+        if (self->camera->takeBulbSequence(count, durationMs, gapMs, nameTemplate))
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_cancelBulb(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        self->camera->cancelBulb();
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_bulbInProgress(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        if (self->camera->bulbInProgress())
+            Py_RETURN_TRUE;
+        else
+            Py_RETURN_FALSE;
+    }
+
+    static PyObject * Camera_bulbReport(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::BulbReport report = self->camera->bulbReport();
+
+        PyObject * exposures = PyList_New(0);
+        if (exposures == NULL)
+            return NULL;
+        for (unsigned int i = 0; i < report.exposures.size(); i++) {
+            const Camera::BulbExposure & exposure = report.exposures[i];
+            PyObject * item = Py_BuildValue("{s:i,s:O,s:L,s:L,s:L,s:L,s:L,s:L,s:L,s:L,s:s}",
+                "exposure", exposure.exposure,
+                "success", exposure.success ? Py_True : Py_False,
+                "requested", exposure.requested,
+                "startSent", exposure.startSent,
+                "startReturned", exposure.startReturned,
+                "endSent", exposure.endSent,
+                "endReturned", exposure.endReturned,
+                "achieved", exposure.achieved,
+                "error", exposure.error,
+                "uncertainty", exposure.uncertainty,
+                "filename", exposure.filename.c_str());
+            if (item == NULL || PyList_Append(exposures, item) != 0) {
+                Py_XDECREF(item);
+                Py_DECREF(exposures);
+                return NULL;
+            }
+            Py_DECREF(item);
+        }
+
+        return Py_BuildValue("{s:i,s:i,s:i,s:N,s:N}",
+            "requested", report.requested,
+            "taken", report.taken,
+            "failed", report.failed,
+            "absoluteError", histogramToDict(report.absoluteError),
+            "exposures", exposures);
+    }
+
     static PyObject * Camera_liveViewImageSize(CameraObject * self, PyObject * args)
     {
         if (! PyArg_ParseTuple(args, ""))
@@ -385,6 +1104,47 @@ extern "C" {
         return Py_BuildValue("s", self->camera->popPictureDoneQueue().c_str());
     }
 
+    static PyObject * Camera_popCompletedPicture(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::CompletedPicture picture;
+        if (! self->camera->popCompletedPicture(picture))
+            Py_RETURN_NONE;
+
+        PyObject * result = pictureFileToDict(picture.filename, picture.cameraFilename, picture.data,
+            picture.checksum, picture.durability, picture.copies, picture.metadata);
+        if (result == NULL)
+            return NULL;
+
+        PyObject * companions = PyList_New(0);
+        if (companions == NULL) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        for (unsigned int i = 0; i < picture.companions.size(); i++) {
+            const Camera::PictureFile & file = picture.companions[i];
+            PyObject * item = pictureFileToDict(file.filename, file.cameraFilename, file.data,
+                file.checksum, file.durability, file.copies, file.metadata);
+            if (item == NULL || PyList_Append(companions, item) != 0) {
+                Py_XDECREF(item);
+                Py_DECREF(companions);
+                Py_DECREF(result);
+                return NULL;
+            }
+            Py_DECREF(item);
+        }
+
+        int failed = PyDict_SetItemString(result, "companions", companions);
+        Py_DECREF(companions);
+        if (failed) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        return result;
+    }
+
     static PyObject * Camera_pictureDoneQueueSize(CameraObject * self, PyObject * args)
     {
         if (! PyArg_ParseTuple(args, ""))
@@ -395,6 +1155,208 @@ extern "C" {
         return Py_BuildValue("i", count);
     }
 
+    static PyObject * Camera_popTransferProgress(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::TransferProgress progress;
+        if (! self->camera->popTransferProgress(progress))
+            Py_RETURN_NONE;
+
+        return Py_BuildValue("{s:i,s:s,s:i,s:L,s:L,s:L}",
+            "transfer", progress.transfer,
+            "cameraFilename", progress.cameraFilename.c_str(),
+            "percent", progress.percent,
+            "size", progress.size,
+            "bytesDone", progress.bytesDone,
+            "elapsed", progress.elapsed);
+    }
+
+    static PyObject * Camera_setPicturePreviews(CameraObject * self, PyObject * args)
+    {
+        int enabled;
+        if (! PyArg_ParseTuple(args, "i", &enabled))
+            return NULL;
+
+        self->camera->setPicturePreviews(enabled != 0);
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_setChecksum(CameraObject * self, PyObject * args)
+    {
+        char * name;
+        if (! PyArg_ParseTuple(args, "s", &name))
+            return NULL;
+
+        Checksum::Algorithm algorithms[] = {Checksum::None, Checksum::Crc32c, Checksum::Sha256};
+        for (unsigned int i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); i++) {
+            if (strcmp(name, Checksum::algorithmName(algorithms[i])) == 0) {
+                self->camera->setChecksum(algorithms[i]);
+                Py_RETURN_NONE;
+            }
+        }
+
+        PyErr_Format(PyExc_ValueError, "unknown checksum algorithm: %s", name);
+        return NULL;
+    }
+
+    static PyObject * Camera_setDurability(CameraObject * self, PyObject * args)
+    {
+        char * name;
+        int interval = 20;
+        if (! PyArg_ParseTuple(args, "s|i", &name, &interval))
+            return NULL;
+
+        Camera::Durability levels[] = {Camera::Unflushed, Camera::FlushEachFile, Camera::GroupCommit};
+        for (unsigned int i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+            if (strcmp(name, Camera::durabilityName(levels[i])) == 0) {
+                self->camera->setDurability(levels[i], interval);
+                Py_RETURN_NONE;
+            }
+        }
+
+        PyErr_Format(PyExc_ValueError, "unknown durability: %s", name);
+        return NULL;
+    }
+
+    static PyObject * Camera_setBackupFolders(CameraObject * self, PyObject * args)
+    {
+        PyObject * list;
+        if (! PyArg_ParseTuple(args, "O!", &PyList_Type, &list))
+            return NULL;
+
+        vector<string> folders;
+        for (Py_ssize_t i = 0; i < PyList_Size(list); i++) {
+            const char * folder = PyUnicode_AsUTF8(PyList_GetItem(list, i));
+            if (folder == NULL)
+                return NULL;
+            folders.push_back(folder);
+        }
+
+        self->camera->setBackupFolders(folders);
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_setKeepPictureData(CameraObject * self, PyObject * args)
+    {
+        int keep;
+        if (! PyArg_ParseTuple(args, "i", &keep))
+            return NULL;
+
+        self->camera->setKeepPictureData(keep != 0);
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_setDerivatives(CameraObject * self, PyObject * args)
+    {
+        PyObject * list;
+        if (! PyArg_ParseTuple(args, "O!", &PyList_Type, &list))
+            return NULL;
+
+        vector<Camera::Derivative> derivatives;
+        for (Py_ssize_t i = 0; i < PyList_Size(list); i++) {
+            Camera::Derivative derivative;
+            char * name;
+            if (! PyArg_ParseTuple(PyList_GetItem(list, i), "sii", &name, &derivative.maxSize, &derivative.quality))
+                return NULL;
+            derivative.name = name;
+            if (derivative.maxSize < 1 || derivative.quality < 1 || derivative.quality > 100) {
+                PyErr_SetString(PyExc_ValueError, "maxSize must be positive and quality 1 to 100");
+                return NULL;
+            }
+            derivatives.push_back(derivative);
+        }
+
+        if (s_derivativePool == NULL && ! derivatives.empty())
+            s_derivativePool = new DecodePool(0, THREAD_PRIORITY_BELOW_NORMAL);
+        self->camera->setDerivatives(s_derivativePool, derivatives);
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_popDerivative(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::DerivativeDone done;
+        if (! self->camera->popDerivative(done))
+            Py_RETURN_NONE;
+
+        PyObject * error;
+        if (done.success) {
+            error = Py_None;
+            Py_INCREF(error);
+        } else {
+            error = PyUnicode_FromString(done.error.c_str());
+            if (error == NULL)
+                return NULL;
+        }
+
+        return Py_BuildValue("{s:s,s:s,s:s,s:i,s:i,s:O,s:N,s:L}",
+            "source", done.source.c_str(),
+            "name", done.name.c_str(),
+            "filename", done.filename.c_str(),
+            "width", done.width,
+            "height", done.height,
+            "success", done.success ? Py_True : Py_False,
+            "error", error,
+            "latency", done.latency);
+    }
+
+    static PyObject * Camera_popPicturePreview(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::PicturePreview preview;
+        if (! self->camera->popPicturePreview(preview))
+            Py_RETURN_NONE;
+
+        PyObject * data = PyBytes_FromStringAndSize(preview.data.empty() ? "" : (const char *) &preview.data[0], preview.data.size());
+        if (data == NULL)
+            return NULL;
+
+        return Py_BuildValue("{s:i,s:s,s:N,s:L,s:L}",
+            "transfer", preview.transfer,
+            "cameraFilename", preview.cameraFilename.c_str(),
+            "data", data,
+            "requestTime", preview.requestTime,
+            "previewTime", preview.previewTime);
+    }
+
+    static PyObject * Camera_transferStats(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::TransferStats stats = self->camera->transferStats();
+
+        return Py_BuildValue("{s:i,s:i,s:L,s:N,s:N,s:N,s:N,s:N}",
+            "transfersCompleted", stats.transfersCompleted,
+            "transfersFailed", stats.transfersFailed,
+            "bytesTransferred", stats.bytesTransferred,
+            "downloadTime", histogramToDict(stats.downloadTime),
+            "requestToCompletion", histogramToDict(stats.requestToCompletion),
+            "throughput", histogramToDict(stats.throughput),
+            "requestToPreview", histogramToDict(stats.requestToPreview),
+            "groupCommitDelay", histogramToDict(stats.groupCommitDelay));
+    }
+
+    static PyObject * Camera_resetTransferStats(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        self->camera->resetTransferStats();
+
+        Py_RETURN_NONE;
+    }
+
     static PyObject * Camera_grabLiveViewFrame(CameraObject * self, PyObject * args)
     {
         if (! PyArg_ParseTuple(args, ""))
@@ -406,6 +1368,169 @@ extern "C" {
             Py_RETURN_FALSE;
     }
 
+    static PyObject * Camera_liveViewFrameInfo(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        Camera::LiveViewFrameInfo info = self->camera->liveViewFrameInfo();
+
+        return Py_BuildValue("iLLL", info.sequence, info.requestTime, info.downloadTime, info.acquireTime);
+    }
+
+    static PyObject * Camera_liveViewStats(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        const Camera::LiveViewStats & stats = self->camera->liveViewStats();
+
+        PyObject * timeInState = PyDict_New();
+        if (timeInState == NULL)
+            return NULL;
+        for (map<string, long long>::const_iterator it = stats.timeInState.begin(); it != stats.timeInState.end(); it++) {
+            PyObject * value = PyLong_FromLongLong(it->second);
+            if (value == NULL || PyDict_SetItemString(timeInState, it->first.c_str(), value) != 0) {
+                Py_XDECREF(value);
+                Py_DECREF(timeInState);
+                return NULL;
+            }
+            Py_DECREF(value);
+        }
+
+        const vector<Camera::LiveViewConsumer *> & consumers = self->camera->liveViewConsumers();
+        PyObject * consumerList = PyList_New(0);
+        if (consumerList == NULL) {
+            Py_DECREF(timeInState);
+            return NULL;
+        }
+        for (unsigned int i = 0; i < consumers.size(); i++) {
+            PyObject * item = Py_BuildValue("{s:l,s:l}",
+                "received", consumers[i]->received(),
+                "dropped", consumers[i]->dropped());
+            if (item == NULL || PyList_Append(consumerList, item) != 0) {
+                Py_XDECREF(item);
+                Py_DECREF(consumerList);
+                Py_DECREF(timeInState);
+                return NULL;
+            }
+            Py_DECREF(item);
+        }
+
+        return Py_BuildValue("{s:i,s:i,s:i,s:i,s:N,s:N,s:N,s:N,s:N,s:i,s:N,s:N}",
+            "framesGrabbed", stats.framesGrabbed,
+            "framesSkippedNotReady", stats.framesSkippedNotReady,
+            "framesSkippedNotOn", stats.framesSkippedNotOn,
+            "framesSkippedExposing", stats.framesSkippedExposing,
+            "downloadLatency", histogramToDict(stats.downloadLatency),
+            "acquireLatency", histogramToDict(stats.acquireLatency),
+            "endToEndLatency", histogramToDict(stats.endToEndLatency),
+            "startLatency", histogramToDict(stats.startLatency),
+            "stopLatency", histogramToDict(stats.stopLatency),
+            "transitionTimeouts", stats.transitionTimeouts,
+            "timeInState", timeInState,
+            "consumers", consumerList);
+    }
+
+    static PyObject * Camera_resetLiveViewStats(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        self->camera->resetLiveViewStats();
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_captureLiveViewMode(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        int mode = self->camera->captureLiveViewMode();
+
+        return Py_BuildValue("i", mode);
+    }
+
+    static PyObject * Camera_setCaptureLiveViewMode(CameraObject * self, PyObject * args)
+    {
+        int mode;
+        if (! PyArg_ParseTuple(args, "i", &mode))
+            return NULL;
+
+        self->camera->setCaptureLiveViewMode((Camera::CaptureLiveViewMode)mode);
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_enableLiveViewDecode(CameraObject * self, PyObject * args)
+    {
+        int scaleDenominator = 1;
+        if (! PyArg_ParseTuple(args, "|i", &scaleDenominator))
+            return NULL;
+
+        if (scaleDenominator != 1 && scaleDenominator != 2 && scaleDenominator != 4 && scaleDenominator != 8) {
+            PyErr_SetString(PyExc_ValueError, "scaleDenominator must be 1, 2, 4 or 8");
+            return NULL;
+        }
+
+        if (s_decodePool == NULL)
+            s_decodePool = new DecodePool();
+
+        self->camera->setLiveViewDecoder(s_decodePool, storeDecodedFrame, self->decoded, scaleDenominator);
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_disableLiveViewDecode(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        self->camera->setLiveViewDecoder(NULL, NULL, NULL);
+
+        Py_RETURN_NONE;
+    }
+
+    static PyObject * Camera_decodedLiveViewFrame(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        DecodedLiveView * decoded = self->decoded;
+        Lock lock(decoded->mutex);
+        if (! decoded->available)
+            Py_RETURN_NONE;
+
+        const Jpeg::Image & image = decoded->image;
+        PyObject * pixels = PyBytes_FromStringAndSize(image.pixels.empty() ? "" : (const char *) &image.pixels[0], image.pixels.size());
+        if (pixels == NULL)
+            return NULL;
+
+        return Py_BuildValue("(i,i,i,N)", decoded->sequence, image.width, image.height, pixels);
+    }
+
+    static PyObject * Camera_liveViewDecodeStats(CameraObject * self, PyObject * args)
+    {
+        if (! PyArg_ParseTuple(args, ""))
+            return NULL;
+
+        DecodePool::ChannelStats stats;
+        if (! self->camera->liveViewDecodeStats(stats))
+            Py_RETURN_NONE;
+
+        return Py_BuildValue("{s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:N,s:N}",
+            "threads", s_decodePool->threadCount(),
+            "framesSubmitted", stats.framesSubmitted,
+            "framesDecoded", stats.framesDecoded,
+            "framesFailed", stats.framesFailed,
+            "framesDropped", stats.framesDropped,
+            "queueDepth", stats.queueDepth,
+            "maxQueueDepth", stats.maxQueueDepth,
+            "queueLatency", histogramToDict(stats.queueLatency),
+            "decodeTime", histogramToDict(stats.decodeTime));
+    }
+
     static PyObject * Camera_autoFocus(CameraObject * self, PyObject * args)
     {
         if (! PyArg_ParseTuple(args, ""))
@@ -423,8 +1548,16 @@ extern "C" {
     static int Camera_getbuffer(CameraObject * self, PyObject * _view, int flags)
     {
 
+        static unsigned char noFrame = 0;
+
         Py_buffer * view = (Py_buffer *) _view;
-        view->buf = (void *) self->camera->liveViewFrameBuffer();
+        // every buffer that is alive at the same time looks at the same
+        // frame, which stays put until the last of them is released
+        if (self->exports == 0)
+            self->camera->acquireLiveViewFrame();
+        ++self->exports;
+        const unsigned char * frame = self->camera->liveViewFrameBuffer();
+        view->buf = (void *) (frame ? frame : &noFrame);
         view->len = self->camera->liveViewFrameBufferSize();
         view->readonly = 1;
         view->format = "B";
@@ -447,6 +1580,9 @@ extern "C" {
         delete[] view->shape;
         delete[] view->strides;
         delete[] view->suboffsets;
+
+        if (--self->exports == 0)
+            self->camera->releaseLiveViewFrame();
     }
     /* --------------------------------------------------------------------- */
 
@@ -459,6 +1595,8 @@ extern "C" {
             return NULL;
 
         self->camera = Camera::getFirstCamera();
+        self->exports = 0;
+        self->decoded = new DecodedLiveView();
 
         if (self->camera == NULL) {
             Camera_dealloc(self);
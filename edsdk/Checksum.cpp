@@ -0,0 +1,206 @@
+#include "Checksum.h"
+
+#include <cstring>
+
+namespace {
+    // reflected Castagnoli polynomial
+    const unsigned int c_crc32cPolynomial = 0x82f63b78;
+
+    // slicing by 8: table k holds the crc of a byte followed by k zero
+    // bytes, which lets us take 8 bytes per step instead of 1.
+    struct CrcTables {
+        unsigned int table[8][256];
+
+        CrcTables() {
+            for (unsigned int i = 0; i < 256; i++) {
+                unsigned int crc = i;
+                for (int bit = 0; bit < 8; bit++)
+                    crc = (crc & 1) ? (crc >> 1) ^ c_crc32cPolynomial : crc >> 1;
+                table[0][i] = crc;
+            }
+            for (unsigned int i = 0; i < 256; i++) {
+                for (int k = 1; k < 8; k++)
+                    table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+            }
+        }
+    };
+    // built before main(), so the transfer threads never race to build it
+    const CrcTables s_crcTables;
+
+    const unsigned int c_sha256K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    inline unsigned int rotr(unsigned int x, int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    void appendHex(string & out, unsigned int value)
+    {
+        static const char digits[] = "0123456789abcdef";
+        for (int shift = 28; shift >= 0; shift -= 4)
+            out += digits[(value >> shift) & 0xf];
+    }
+}
+
+Checksum::Checksum(Algorithm algorithm) :
+    m_algorithm(algorithm)
+{
+    reset();
+}
+
+void Checksum::reset()
+{
+    m_crc = 0xffffffff;
+
+    static const unsigned int initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(m_sha, initial, sizeof(m_sha));
+    m_shaLength = 0;
+    m_shaBlockUsed = 0;
+}
+
+void Checksum::update(const void * data, size_t length)
+{
+    const unsigned char * bytes = (const unsigned char *) data;
+    switch (m_algorithm) {
+        case None: break;
+        case Crc32c: crcUpdate(bytes, length); break;
+        case Sha256: shaUpdate(bytes, length); break;
+    }
+}
+
+string Checksum::digest() const
+{
+    string out;
+    switch (m_algorithm) {
+        case None:
+            return out;
+        case Crc32c:
+            out = "crc32c:";
+            appendHex(out, ~m_crc);
+            return out;
+        case Sha256: {
+            // finish a copy, so that we can keep going
+            Checksum copy = *this;
+            unsigned long long bits = copy.m_shaLength * 8;
+            unsigned char pad[72];
+            memset(pad, 0, sizeof(pad));
+            pad[0] = 0x80;
+            // pad to 56 mod 64, then the length as a big endian 64 bit number
+            size_t padLength = (m_shaBlockUsed < 56 ? 56 : 120) - m_shaBlockUsed;
+            for (int i = 0; i < 8; i++)
+                pad[padLength + i] = (unsigned char) (bits >> (56 - 8 * i));
+            copy.shaUpdate(pad, padLength + 8);
+
+            out = "sha256:";
+            for (int i = 0; i < 8; i++)
+                appendHex(out, copy.m_sha[i]);
+            return out;
+        }
+    }
+    return out;
+}
+
+const char * Checksum::algorithmName(Algorithm algorithm)
+{
+    switch (algorithm) {
+        case None: return "none";
+        case Crc32c: return "crc32c";
+        case Sha256: return "sha256";
+    }
+    return "unknown";
+}
+
+void Checksum::crcUpdate(const unsigned char * data, size_t length)
+{
+    const unsigned int (* t)[256] = s_crcTables.table;
+    unsigned int crc = m_crc;
+
+    while (length >= 8) {
+        unsigned int low = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int) data[3] << 24));
+        crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+            ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xff];
+        ++data;
+        --length;
+    }
+
+    m_crc = crc;
+}
+
+void Checksum::shaUpdate(const unsigned char * data, size_t length)
+{
+    m_shaLength += length;
+
+    if (m_shaBlockUsed > 0) {
+        size_t take = 64 - m_shaBlockUsed;
+        if (take > length)
+            take = length;
+        memcpy(m_shaBlock + m_shaBlockUsed, data, take);
+        m_shaBlockUsed += take;
+        data += take;
+        length -= take;
+        if (m_shaBlockUsed < 64)
+            return;
+        shaTransform(m_sha, m_shaBlock);
+        m_shaBlockUsed = 0;
+    }
+
+    // whole blocks straight from the caller's buffer
+    while (length >= 64) {
+        shaTransform(m_sha, data);
+        data += 64;
+        length -= 64;
+    }
+
+    memcpy(m_shaBlock, data, length);
+    m_shaBlockUsed = length;
+}
+
+void Checksum::shaTransform(unsigned int state[8], const unsigned char block[64])
+{
+    unsigned int w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = ((unsigned int) block[4 * i] << 24) | (block[4 * i + 1] << 16) | (block[4 * i + 2] << 8) | block[4 * i + 3];
+    for (int i = 16; i < 64; i++) {
+        unsigned int s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        unsigned int s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    unsigned int a = state[0], b = state[1], c = state[2], d = state[3];
+    unsigned int e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        unsigned int s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+        unsigned int ch = (e & f) ^ (~e & g);
+        unsigned int t1 = h + s1 + ch + c_sha256K[i] + w[i];
+        unsigned int s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+        unsigned int maj = (a & b) ^ (a & c) ^ (b & c);
+        unsigned int t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
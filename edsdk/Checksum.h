@@ -0,0 +1,47 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <string>
+#include <cstddef>
+using namespace std;
+
+// a checksum that is fed as the bytes go by, so a file doesn't have to be
+// read back to be hashed.
+class Checksum
+{
+    public:
+        enum Algorithm {
+            None,
+            // what iSCSI and ext4 use. fast, catches corruption, not tampering.
+            Crc32c,
+            Sha256,
+        };
+
+        explicit Checksum(Algorithm algorithm = None);
+
+        void reset();
+        void update(const void * data, size_t length);
+
+        Algorithm algorithm() const { return m_algorithm; }
+        // "algorithm:hex digest", for example "crc32c:e3069283". empty for None.
+        // doesn't disturb the running checksum, so you can keep updating it.
+        string digest() const;
+
+        static const char * algorithmName(Algorithm algorithm);
+
+    private:
+        Algorithm m_algorithm;
+
+        unsigned int m_crc;
+
+        unsigned int m_sha[8];
+        unsigned long long m_shaLength;
+        unsigned char m_shaBlock[64];
+        unsigned int m_shaBlockUsed;
+
+        void crcUpdate(const unsigned char * data, size_t length);
+        void shaUpdate(const unsigned char * data, size_t length);
+        static void shaTransform(unsigned int state[8], const unsigned char block[64]);
+};
+
+#endif
@@ -0,0 +1,358 @@
+#include "DecodePool.h"
+
+#include "Utils.h"
+
+#include <cassert>
+using namespace std;
+
+DecodePool::ChannelStats::ChannelStats() :
+    framesSubmitted(0),
+    framesDecoded(0),
+    framesFailed(0),
+    framesDropped(0),
+    queueDepth(0),
+    maxQueueDepth(0)
+{
+}
+
+DecodePool::DecodePool(int threadCount, int priority) :
+    m_nextWorker(0),
+    m_stopping(0)
+{
+    if (threadCount <= 0) {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        threadCount = info.dwNumberOfProcessors;
+    }
+
+    for (int i = 0; i < threadCount; i++) {
+        Worker * worker = new Worker();
+        worker->pool = this;
+        worker->index = i;
+        m_workers.push_back(worker);
+    }
+
+    // start them only once they can all see each other, for stealing
+    for (unsigned int i = 0; i < m_workers.size(); i++) {
+        m_workers[i]->thread.start(&DecodePool::workerThread, m_workers[i]);
+        if (priority != THREAD_PRIORITY_NORMAL)
+            m_workers[i]->thread.setPriority(priority);
+    }
+}
+
+DecodePool::~DecodePool()
+{
+    InterlockedExchange(&m_stopping, 1);
+    m_jobsAvailable.post(m_workers.size());
+
+    for (unsigned int i = 0; i < m_workers.size(); i++) {
+        Worker * worker = m_workers[i];
+        worker->thread.join();
+        for (deque<Job *>::iterator it = worker->jobs.begin(); it != worker->jobs.end(); it++)
+            delete *it;
+        delete worker;
+    }
+
+    for (unsigned int i = 0; i < m_channels.size(); i++) {
+        Channel * channel = m_channels[i];
+        for (map<int, DecodedFrame *>::iterator it = channel->finished.begin(); it != channel->finished.end(); it++)
+            delete it->second;
+        delete channel;
+    }
+}
+
+int DecodePool::addChannel(DecodedFrameCallback callback, void * context, int maxQueueDepth, int scaleDenominator,
+    ProcessFrameCallback process)
+{
+    Channel * channel = new Channel();
+    channel->callback = callback;
+    channel->process = process;
+    channel->context = context;
+    channel->maxQueueDepth = maxQueueDepth;
+    channel->scaleDenominator = scaleDenominator;
+    channel->open = true;
+    channel->processing = 0;
+    channel->closeWaiting = false;
+    channel->waitingForRoom = 0;
+    channel->nextOrder = 0;
+    channel->nextToDeliver = 0;
+
+    Lock lock(m_channelsMutex);
+    m_channels.push_back(channel);
+    return m_channels.size() - 1;
+}
+
+void DecodePool::closeChannel(int index)
+{
+    Channel * channel;
+    {
+        Lock lock(m_channelsMutex);
+        channel = m_channels[index];
+    }
+
+    bool busy;
+    {
+        Lock lock(channel->mutex);
+        channel->open = false;
+        channel->callback = NULL;
+        channel->process = NULL;
+
+        if (channel->waitingForRoom > 0) {
+            channel->room.post(channel->waitingForRoom);
+            channel->waitingForRoom = 0;
+        }
+
+        // the context may go away once we return, so wait out anybody who
+        // is still using it
+        busy = channel->processing > 0;
+        channel->closeWaiting = busy;
+    }
+    if (busy)
+        channel->idle.wait();
+}
+
+bool DecodePool::submit(int index, int sequence, const unsigned char * data, int size)
+{
+    Job * job = new Job();
+    job->channel = index;
+    job->sequence = sequence;
+    job->scaleDenominator = 0;
+    job->submitTime = Utils::monotonicMicros();
+
+    if (! admit(job))
+        return false;
+
+    job->data.assign(data, data + size);
+    dispatch(job);
+    return true;
+}
+
+bool DecodePool::submit(int index, int sequence, vector<unsigned char> & data, int scaleDenominator)
+{
+    Job * job = new Job();
+    job->channel = index;
+    job->sequence = sequence;
+    job->scaleDenominator = scaleDenominator;
+    job->submitTime = Utils::monotonicMicros();
+
+    if (! admit(job))
+        return false;
+
+    job->data.swap(data);
+    dispatch(job);
+    return true;
+}
+
+bool DecodePool::admit(Job * job)
+{
+    Channel * channel;
+    {
+        Lock lock(m_channelsMutex);
+        channel = m_channels[job->channel];
+    }
+
+    ChannelStats & stats = channel->stats;
+    while (true) {
+        {
+            Lock lock(channel->mutex);
+            if (! channel->open) {
+                delete job;
+                return false;
+            }
+
+            if (stats.queueDepth < channel->maxQueueDepth) {
+                ++stats.framesSubmitted;
+                ++stats.queueDepth;
+                if (stats.queueDepth > stats.maxQueueDepth)
+                    stats.maxQueueDepth = stats.queueDepth;
+
+                job->order = channel->nextOrder++;
+                return true;
+            }
+
+            if (channel->callback) {
+                // the pool can't keep up. newer frames are coming anyway.
+                ++stats.framesDropped;
+                delete job;
+                return false;
+            }
+            ++channel->waitingForRoom;
+        }
+        channel->room.wait();
+    }
+}
+
+void DecodePool::dispatch(Job * job)
+{
+    Worker * worker = m_workers[(unsigned long) InterlockedIncrement(&m_nextWorker) % m_workers.size()];
+    {
+        Lock lock(worker->mutex);
+        worker->jobs.push_back(job);
+    }
+    m_jobsAvailable.post();
+}
+
+DecodePool::ChannelStats DecodePool::channelStats(int index)
+{
+    Channel * channel;
+    {
+        Lock lock(m_channelsMutex);
+        channel = m_channels[index];
+    }
+
+    Lock lock(channel->mutex);
+    return channel->stats;
+}
+
+void DecodePool::workerThread(void * context)
+{
+    Worker * worker = (Worker *) context;
+    worker->pool->work(worker);
+}
+
+void DecodePool::work(Worker * worker)
+{
+    while (true) {
+        m_jobsAvailable.wait();
+        if (InterlockedCompareExchange(&m_stopping, 0, 0))
+            return;
+
+        // every post has a job of its own, but another worker can take
+        // ours while we look in the wrong queue, leaving theirs behind
+        // where we already looked. it is still in some queue, so look again.
+        Job * job;
+        while (! (job = takeJob(worker))) {
+            if (InterlockedCompareExchange(&m_stopping, 0, 0))
+                return;
+            Sleep(0);
+        }
+
+        int scaleDenominator = job->scaleDenominator;
+        if (scaleDenominator == 0) {
+            Lock lock(m_channelsMutex);
+            scaleDenominator = m_channels[job->channel]->scaleDenominator;
+        }
+
+        DecodedFrame * frame = new DecodedFrame();
+        frame->channel = job->channel;
+        frame->sequence = job->sequence;
+        frame->submitTime = job->submitTime;
+        frame->decodeStartTime = Utils::monotonicMicros();
+        frame->success = Jpeg::decode(&job->data[0], job->data.size(), frame->image, scaleDenominator);
+        frame->decodeEndTime = Utils::monotonicMicros();
+
+        process(job, frame);
+        finish(job, frame);
+    }
+}
+
+void DecodePool::process(Job * job, DecodedFrame * frame)
+{
+    Channel * channel;
+    {
+        Lock lock(m_channelsMutex);
+        channel = m_channels[job->channel];
+    }
+
+    ProcessFrameCallback callback;
+    void * context;
+    {
+        Lock lock(channel->mutex);
+        if (! channel->open || ! channel->process)
+            return;
+        callback = channel->process;
+        context = channel->context;
+        ++channel->processing;
+    }
+
+    // outside the lock, so frames of the same channel get processed at
+    // the same time on different workers
+    callback(*frame, context);
+
+    Lock lock(channel->mutex);
+    if (--channel->processing == 0 && channel->closeWaiting) {
+        channel->closeWaiting = false;
+        channel->idle.post();
+    }
+}
+
+DecodePool::Job * DecodePool::takeJob(Worker * worker)
+{
+    // oldest job from our own queue first
+    {
+        Lock lock(worker->mutex);
+        if (! worker->jobs.empty()) {
+            Job * job = worker->jobs.front();
+            worker->jobs.pop_front();
+            return job;
+        }
+    }
+
+    // then steal from the other end of somebody else's queue, so that we
+    // don't fight the owner over the same jobs
+    int count = m_workers.size();
+    for (int i = 1; i < count; i++) {
+        Worker * victim = m_workers[(worker->index + i) % count];
+        Lock lock(victim->mutex);
+        if (! victim->jobs.empty()) {
+            Job * job = victim->jobs.back();
+            victim->jobs.pop_back();
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+void DecodePool::finish(Job * job, DecodedFrame * frame)
+{
+    Channel * channel;
+    {
+        Lock lock(m_channelsMutex);
+        channel = m_channels[job->channel];
+    }
+
+    Lock lock(channel->mutex);
+
+    ChannelStats & stats = channel->stats;
+    if (frame->success)
+        ++stats.framesDecoded;
+    else
+        ++stats.framesFailed;
+    stats.queueLatency.add(frame->decodeStartTime - frame->submitTime);
+    stats.decodeTime.add(frame->decodeEndTime - frame->decodeStartTime);
+
+    if (! channel->callback) {
+        // nobody to deliver to, so there is no order to wait for either
+        delete frame;
+        delete job;
+        makeRoom(channel);
+        return;
+    }
+
+    channel->finished[job->order] = frame;
+    delete job;
+
+    // hand out everything that is now in order
+    map<int, DecodedFrame *>::iterator it;
+    while ((it = channel->finished.find(channel->nextToDeliver)) != channel->finished.end()) {
+        DecodedFrame * next = it->second;
+        channel->finished.erase(it);
+        ++channel->nextToDeliver;
+        makeRoom(channel);
+
+        if (channel->open && channel->callback)
+            channel->callback(*next, channel->context);
+        delete next;
+    }
+}
+
+void DecodePool::makeRoom(Channel * channel)
+{
+    --channel->stats.queueDepth;
+    // one post per waiter, each of which checks again for itself
+    if (channel->waitingForRoom > 0) {
+        --channel->waitingForRoom;
+        channel->room.post();
+    }
+}
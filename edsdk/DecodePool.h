@@ -0,0 +1,160 @@
+#ifndef DECODE_POOL_H
+#define DECODE_POOL_H
+
+#include <deque>
+#include <map>
+#include <vector>
+using namespace std;
+
+#include "Histogram.h"
+#include "Jpeg.h"
+#include "Threading.h"
+
+// a pool of threads which decodes jpeg frames, shared by any number of
+// sources (usually the live view streams of several cameras). every worker
+// has its own queue and steals from the others when it runs dry, so all the
+// cores stay busy even when one camera sends more frames than another.
+// results for a channel come back in the order they were submitted.
+class DecodePool
+{
+    public:
+        struct DecodedFrame {
+            int channel;
+            // whatever the submitter passed in, for example the live view
+            // frame sequence number
+            int sequence;
+            bool success;
+            Jpeg::Image image;
+            // monotonic microseconds, see Utils::monotonicMicros()
+            long long submitTime;
+            long long decodeStartTime;
+            long long decodeEndTime;
+        };
+
+        // called on a worker thread, one frame at a time per channel.
+        // don't take long, the next frame of the channel waits for you.
+        typedef void (* DecodedFrameCallback) (const DecodedFrame & frame, void * context);
+        // called on the worker thread that decoded the frame, as soon as it
+        // is decoded, and alongside the other workers. for work on every
+        // frame that shouldn't hold up the ones after it, like writing
+        // resized copies. it gets the same context as the callback.
+        typedef void (* ProcessFrameCallback) (DecodedFrame & frame, void * context);
+
+        struct ChannelStats {
+            int framesSubmitted;
+            int framesDecoded;
+            int framesFailed;
+            // refused because too many frames were already waiting
+            int framesDropped;
+            // submitted but not delivered yet. without a callback there is
+            // nothing to deliver, so it is until they are processed.
+            int queueDepth;
+            int maxQueueDepth;
+            // submit -> decode start
+            Histogram queueLatency;
+            Histogram decodeTime;
+
+            ChannelStats();
+        };
+
+        // threadCount 0 means one thread per processor. priority is one of
+        // the THREAD_PRIORITY_ values, for a pool that should give way to
+        // another one.
+        explicit DecodePool(int threadCount = 0, int priority = THREAD_PRIORITY_NORMAL);
+        ~DecodePool();
+
+        // each source of frames gets a channel. maxQueueDepth is how many
+        // frames can be waiting before submit() starts dropping them.
+        // scaleDenominator is passed to Jpeg::decode. callback can be NULL
+        // if process does everything. no newer frame makes up for one such
+        // a channel loses, so submit() waits for room instead of dropping.
+        int addChannel(DecodedFrameCallback callback, void * context, int maxQueueDepth = 4, int scaleDenominator = 1,
+            ProcessFrameCallback process = NULL);
+        // stop delivering results for a channel. frames in flight are thrown
+        // away, and submits waiting for room give up. waits for process
+        // callbacks that have already started.
+        void closeChannel(int channel);
+
+        // copies the data. returns false if the frame was dropped.
+        bool submit(int channel, int sequence, const unsigned char * data, int size);
+        // takes the data instead of copying it, which leaves data empty
+        // unless the frame was dropped. scaleDenominator overrides the
+        // channel's for this frame, if it isn't 0.
+        bool submit(int channel, int sequence, vector<unsigned char> & data, int scaleDenominator = 0);
+
+        ChannelStats channelStats(int channel);
+        int threadCount() const { return m_workers.size(); }
+
+    private:
+        struct Job {
+            int channel;
+            // position in the channel, for putting results back in order
+            int order;
+            int sequence;
+            // 0 for the channel's
+            int scaleDenominator;
+            vector<unsigned char> data;
+            long long submitTime;
+        };
+
+        struct Worker {
+            DecodePool * pool;
+            int index;
+            Thread thread;
+            Mutex mutex;
+            deque<Job *> jobs;
+        };
+
+        struct Channel {
+            Mutex mutex;
+            DecodedFrameCallback callback;
+            ProcessFrameCallback process;
+            void * context;
+            int maxQueueDepth;
+            int scaleDenominator;
+            bool open;
+            // process callbacks running right now
+            int processing;
+            // closeChannel() waits on idle for processing to get to 0
+            bool closeWaiting;
+            Semaphore idle;
+            // submits waiting for the queue depth to drop, see makeRoom()
+            int waitingForRoom;
+            Semaphore room;
+            int nextOrder;
+            int nextToDeliver;
+            // decoded frames waiting for the ones before them
+            map<int, DecodedFrame *> finished;
+            ChannelStats stats;
+        };
+
+        static void workerThread(void * context);
+        void work(Worker * worker);
+        Job * takeJob(Worker * worker);
+        // gives the job its place in the channel. returns false, and
+        // deletes it, if the channel won't take it.
+        bool admit(Job * job);
+        // hands it to a worker
+        void dispatch(Job * job);
+        void process(Job * job, DecodedFrame * frame);
+        void finish(Job * job, DecodedFrame * frame);
+        // takes a frame off the queue depth and lets a waiting submit in.
+        // call with the channel's mutex held.
+        void makeRoom(Channel * channel);
+
+        vector<Worker *> m_workers;
+        // one post per job in any of the queues
+        Semaphore m_jobsAvailable;
+        // where the next job goes, round robin
+        volatile LONG m_nextWorker;
+        volatile LONG m_stopping;
+
+        Mutex m_channelsMutex;
+        vector<Channel *> m_channels;
+
+        // not copyable
+        DecodePool(const DecodePool &);
+        DecodePool & operator=(const DecodePool &);
+};
+
+#endif
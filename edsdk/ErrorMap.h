@@ -13,11 +13,13 @@ class ErrorMap {
     public:
         static string errorMsg(EdsError err);
 
+        // errorMsg() does this for you, but call it before starting any
+        // threads which might report errors at the same time
+        static void initialize();
+
     private:
         static bool s_initialized;
         static map<EdsError, string> s_messages;
-
-        static void initialize();
 };
 
 #endif
@@ -0,0 +1,329 @@
+#include "Exif.h"
+
+#include <cstring>
+
+#include <windows.h>
+
+namespace {
+    // IFD0 and the EXIF IFD are near the start of the file, but a RAW can
+    // put them further in. big files only get this much of them mapped.
+    const long long c_maxMappedSize = 0x4000000;
+
+    // the tags we read
+    enum Tag {
+        TagMake = 0x010f,
+        TagModel = 0x0110,
+        TagOrientation = 0x0112,
+        TagExifIfd = 0x8769,
+        TagExposureTime = 0x829a,
+        TagFNumber = 0x829d,
+        TagIso = 0x8827,
+        TagRecommendedExposureIndex = 0x8832,
+        TagDateTimeOriginal = 0x9003,
+        TagExposureBias = 0x9204,
+        TagFlash = 0x9209,
+        TagFocalLength = 0x920a,
+        TagSubSecTimeOriginal = 0x9291,
+        TagWidth = 0xa002,
+        TagHeight = 0xa003,
+        TagBodySerialNumber = 0xa431,
+        TagLensModel = 0xa434,
+    };
+
+    enum Type {
+        TypeByte = 1,
+        TypeAscii = 2,
+        TypeShort = 3,
+        TypeLong = 4,
+        TypeRational = 5,
+        TypeUndefined = 7,
+        TypeSignedLong = 9,
+        TypeSignedRational = 10,
+    };
+
+    // a TIFF structure in memory. every read is checked against the end,
+    // since the bytes come from a camera, or from a half written file.
+    struct Tiff {
+        const unsigned char * data;
+        size_t size;
+        bool bigEndian;
+
+        bool u16(size_t offset, unsigned int & value) const
+        {
+            if (offset > size || size - offset < 2)
+                return false;
+            const unsigned char * p = data + offset;
+            value = bigEndian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+            return true;
+        }
+
+        bool u32(size_t offset, unsigned int & value) const
+        {
+            if (offset > size || size - offset < 4)
+                return false;
+            const unsigned char * p = data + offset;
+            if (bigEndian)
+                value = ((unsigned int) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+            else
+                value = ((unsigned int) p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+            return true;
+        }
+    };
+
+    // one 12 byte entry of an IFD
+    struct Entry {
+        unsigned int tag;
+        unsigned int type;
+        unsigned int count;
+        // where the value is. small ones are inside the entry.
+        size_t offset;
+    };
+
+    size_t typeSize(unsigned int type)
+    {
+        switch (type) {
+            case TypeByte: case TypeAscii: case TypeUndefined: return 1;
+            case TypeShort: return 2;
+            case TypeLong: case TypeSignedLong: return 4;
+            case TypeRational: case TypeSignedRational: return 8;
+            default: return 0;
+        }
+    }
+
+    bool readEntry(const Tiff & tiff, size_t offset, Entry & entry)
+    {
+        unsigned int valueOffset;
+        if (! tiff.u16(offset, entry.tag) || ! tiff.u16(offset + 2, entry.type)
+            || ! tiff.u32(offset + 4, entry.count) || ! tiff.u32(offset + 8, valueOffset))
+        {
+            return false;
+        }
+
+        size_t size = typeSize(entry.type);
+        if (size == 0 || entry.count == 0 || entry.count > tiff.size / size)
+            return false;
+        entry.offset = size * entry.count <= 4 ? offset + 8 : valueOffset;
+        return entry.offset <= tiff.size && tiff.size - entry.offset >= size * entry.count;
+    }
+
+    void readString(const Tiff & tiff, const Entry & entry, char * out, size_t outSize)
+    {
+        if (entry.type != TypeAscii && entry.type != TypeUndefined)
+            return;
+        size_t length = entry.count < outSize - 1 ? entry.count : outSize - 1;
+        memcpy(out, tiff.data + entry.offset, length);
+        out[length] = '\0';
+        // padded with NULs or spaces to a fixed width
+        length = strlen(out);
+        while (length > 0 && out[length - 1] == ' ')
+            out[--length] = '\0';
+    }
+
+    bool readUnsigned(const Tiff & tiff, const Entry & entry, unsigned int & value)
+    {
+        if (entry.type == TypeShort)
+            return tiff.u16(entry.offset, value);
+        if (entry.type == TypeLong)
+            return tiff.u32(entry.offset, value);
+        return false;
+    }
+
+    bool readRational(const Tiff & tiff, const Entry & entry, unsigned int & numerator, unsigned int & denominator)
+    {
+        if (entry.type != TypeRational && entry.type != TypeSignedRational)
+            return false;
+        return tiff.u32(entry.offset, numerator) && tiff.u32(entry.offset + 4, denominator) && denominator != 0;
+    }
+
+    double readDouble(const Tiff & tiff, const Entry & entry)
+    {
+        unsigned int numerator, denominator;
+        if (! readRational(tiff, entry, numerator, denominator))
+            return 0;
+        if (entry.type == TypeSignedRational)
+            return (double) (int) numerator / (int) denominator;
+        return (double) numerator / denominator;
+    }
+
+    void readTag(const Tiff & tiff, const Entry & entry, Exif::Metadata & metadata, unsigned int & recommendedIndex)
+    {
+        unsigned int value = 0;
+        switch (entry.tag) {
+            case TagMake: readString(tiff, entry, metadata.make, sizeof(metadata.make)); break;
+            case TagModel: readString(tiff, entry, metadata.model, sizeof(metadata.model)); break;
+            case TagBodySerialNumber: readString(tiff, entry, metadata.serialNumber, sizeof(metadata.serialNumber)); break;
+            case TagLensModel: readString(tiff, entry, metadata.lensModel, sizeof(metadata.lensModel)); break;
+            case TagDateTimeOriginal: readString(tiff, entry, metadata.dateTimeOriginal, sizeof(metadata.dateTimeOriginal)); break;
+            case TagSubSecTimeOriginal: readString(tiff, entry, metadata.subSecTimeOriginal, sizeof(metadata.subSecTimeOriginal)); break;
+            case TagExposureTime:
+                if (readRational(tiff, entry, metadata.exposureNumerator, metadata.exposureDenominator))
+                    metadata.exposureTime = (double) metadata.exposureNumerator / metadata.exposureDenominator;
+                break;
+            case TagFNumber: metadata.fNumber = readDouble(tiff, entry); break;
+            case TagExposureBias: metadata.exposureBias = readDouble(tiff, entry); break;
+            case TagFocalLength: metadata.focalLength = readDouble(tiff, entry); break;
+            case TagIso: if (readUnsigned(tiff, entry, value)) metadata.iso = value; break;
+            case TagRecommendedExposureIndex: readUnsigned(tiff, entry, recommendedIndex); break;
+            case TagOrientation: if (readUnsigned(tiff, entry, value)) metadata.orientation = value; break;
+            case TagFlash: if (readUnsigned(tiff, entry, value)) metadata.flash = value; break;
+            case TagWidth: if (readUnsigned(tiff, entry, value)) metadata.width = value; break;
+            case TagHeight: if (readUnsigned(tiff, entry, value)) metadata.height = value; break;
+        }
+    }
+
+    // reads the tags of the IFD at offset, and says where the EXIF IFD is
+    // if it points to one
+    bool readIfd(const Tiff & tiff, size_t offset, Exif::Metadata & metadata, unsigned int & recommendedIndex, unsigned int & exifIfd)
+    {
+        unsigned int count;
+        if (! tiff.u16(offset, count))
+            return false;
+
+        for (unsigned int i = 0; i < count; i++) {
+            Entry entry;
+            if (! readEntry(tiff, offset + 2 + i * 12, entry))
+                continue;
+            if (entry.tag == TagExifIfd)
+                readUnsigned(tiff, entry, exifIfd);
+            else
+                readTag(tiff, entry, metadata, recommendedIndex);
+        }
+        return true;
+    }
+
+    bool parseTiff(const unsigned char * data, size_t size, Exif::Metadata & metadata)
+    {
+        Tiff tiff;
+        tiff.data = data;
+        tiff.size = size;
+        if (size < 8)
+            return false;
+        if (data[0] == 'I' && data[1] == 'I')
+            tiff.bigEndian = false;
+        else if (data[0] == 'M' && data[1] == 'M')
+            tiff.bigEndian = true;
+        else
+            return false;
+
+        unsigned int magic, ifd0;
+        if (! tiff.u16(2, magic) || magic != 42 || ! tiff.u32(4, ifd0))
+            return false;
+
+        unsigned int recommendedIndex = 0;
+        unsigned int exifIfd = 0;
+        if (! readIfd(tiff, ifd0, metadata, recommendedIndex, exifIfd))
+            return false;
+        // only followed once, so a pointer back to IFD0 can't loop
+        if (exifIfd && exifIfd != ifd0) {
+            unsigned int ignored = 0;
+            readIfd(tiff, exifIfd, metadata, recommendedIndex, ignored);
+        }
+
+        // the ISO tag is a short, so from ISO 65535 up cameras leave it at
+        // that and put the real one in the recommended exposure index
+        if (metadata.iso == 65535 && recommendedIndex)
+            metadata.iso = recommendedIndex;
+
+        metadata.valid = true;
+        return true;
+    }
+
+    // finds the APP1 segment with the EXIF in it, before the image data
+    bool parseJpeg(const unsigned char * data, size_t size, Exif::Metadata & metadata)
+    {
+        static const unsigned char exifHeader[] = {'E', 'x', 'i', 'f', 0, 0};
+
+        size_t position = 2;
+        while (position + 4 <= size) {
+            if (data[position] != 0xff)
+                return false;
+            unsigned char marker = data[position + 1];
+            // padding
+            if (marker == 0xff) {
+                ++position;
+                continue;
+            }
+            // markers without a length
+            if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+                position += 2;
+                continue;
+            }
+            // the image data starts, or the file ends, with no EXIF
+            if (marker == 0xda || marker == 0xd9)
+                return false;
+
+            size_t length = (data[position + 2] << 8) | data[position + 3];
+            if (length < 2 || length > size - position - 2)
+                return false;
+            const unsigned char * segment = data + position + 4;
+            size_t segmentSize = length - 2;
+            if (marker == 0xe1 && segmentSize > sizeof(exifHeader)
+                && memcmp(segment, exifHeader, sizeof(exifHeader)) == 0)
+            {
+                return parseTiff(segment + sizeof(exifHeader), segmentSize - sizeof(exifHeader), metadata);
+            }
+            position += 2 + length;
+        }
+        return false;
+    }
+}
+
+Exif::Metadata::Metadata() :
+    valid(false),
+    exposureNumerator(0),
+    exposureDenominator(0),
+    exposureTime(0),
+    fNumber(0),
+    iso(0),
+    exposureBias(0),
+    focalLength(0),
+    orientation(0),
+    flash(0),
+    width(0),
+    height(0)
+{
+    make[0] = '\0';
+    model[0] = '\0';
+    serialNumber[0] = '\0';
+    lensModel[0] = '\0';
+    dateTimeOriginal[0] = '\0';
+    subSecTimeOriginal[0] = '\0';
+}
+
+bool Exif::parse(const unsigned char * data, size_t size, Metadata & metadata)
+{
+    metadata = Metadata();
+    if (data == NULL || size < 4)
+        return false;
+
+    if (data[0] == 0xff && data[1] == 0xd8)
+        return parseJpeg(data, size, metadata);
+    // CR2 and friends are TIFFs to begin with
+    return parseTiff(data, size, metadata);
+}
+
+bool Exif::parseFile(const string & path, Metadata & metadata)
+{
+    metadata = Metadata();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    bool success = false;
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+        size_t viewSize = (size_t) (fileSize.QuadPart < c_maxMappedSize ? fileSize.QuadPart : c_maxMappedSize);
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) {
+            const unsigned char * view = (const unsigned char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, viewSize);
+            if (view != NULL) {
+                success = parse(view, viewSize, metadata);
+                UnmapViewOfFile(view);
+            }
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+    return success;
+}
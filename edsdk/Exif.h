@@ -0,0 +1,58 @@
+#ifndef EXIF_H
+#define EXIF_H
+
+#include <string>
+#include <cstddef>
+using namespace std;
+
+// reads the tags people usually want out of a picture's EXIF block, right
+// off the downloaded bytes. nothing is allocated, so it's cheap enough to
+// do for every picture as it comes in.
+class Exif
+{
+    public:
+        // fixed size, so that filling it in doesn't allocate. strings are
+        // cut off if they don't fit, and empty if the tag isn't there;
+        // numbers are 0.
+        struct Metadata {
+            // whether an EXIF block was found at all
+            bool valid;
+
+            char make[32];
+            char model[64];
+            char serialNumber[32];
+            char lensModel[64];
+            // "YYYY:MM:DD HH:MM:SS", camera local time
+            char dateTimeOriginal[20];
+            // fractions of a second, as digits, like "42"
+            char subSecTimeOriginal[8];
+
+            // the shutter speed is a fraction, like 1/250
+            unsigned int exposureNumerator;
+            unsigned int exposureDenominator;
+            double exposureTime;
+            double fNumber;
+            unsigned int iso;
+            // in stops
+            double exposureBias;
+            // in mm, of the lens, not 35mm equivalent
+            double focalLength;
+            // 1 to 8, see the EXIF spec. 1 is the right way up.
+            int orientation;
+            // the raw EXIF flash value. bit 0 is whether it fired.
+            int flash;
+            int width;
+            int height;
+
+            Metadata();
+        };
+
+        // data is a JPEG, or a TIFF based RAW like CR2. returns false if
+        // there is no EXIF in it.
+        static bool parse(const unsigned char * data, size_t size, Metadata & metadata);
+        // maps the file and parses it in place. only the pages the tags
+        // are on get read.
+        static bool parseFile(const string & path, Metadata & metadata);
+};
+
+#endif
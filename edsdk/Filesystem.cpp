@@ -2,12 +2,17 @@
 
 #include <fstream>
 #include <cstdio>
+#include <cerrno>
+#include <vector>
 using namespace std;
 
 #include "Utils.h"
 using namespace Utils;
 
 #include <dir.h>
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
 
 bool Filesystem::fileExists(string filename)
 {
@@ -95,13 +100,75 @@ string Filesystem::pathCombine(string part1, string part2)
     return part1 + part2;
 }
 
-void Filesystem::moveFile(string source, string dest)
+string Filesystem::createUniqueFile(string path)
 {
-    if (rename(source.c_str(), dest.c_str()) != 0) {
-        // error
-        fprintf(stderr, "ERROR: could not move %s to %s\n", source.c_str(), dest.c_str());
-        perror("(above)");
+    string proposed = path;
+    // if somebody else creates the name we came up with first, try the next one
+    for (int attempt = 0; attempt < 100; attempt++) {
+        proposed = makeUnique(proposed);
+        int fd = open(proposed.c_str(), O_CREAT | O_EXCL | O_WRONLY, S_IREAD | S_IWRITE);
+        if (fd != -1) {
+            close(fd);
+            return proposed;
+        }
+        if (errno != EEXIST)
+            break;
     }
+
+    fprintf(stderr, "ERROR: could not create a file like %s\n", path.c_str());
+    perror("(above)");
+    return "";
+}
+
+bool Filesystem::moveFile(string source, string dest, bool flush)
+{
+    if (rename(source.c_str(), dest.c_str()) == 0)
+        return true;
+
+    // rename can't cross volumes, so copy it the long way
+    if (errno == EXDEV && ! fileExists(dest)) {
+        if (copyFile(source, dest) && (! flush || flushFile(dest))) {
+            remove(source.c_str());
+            return true;
+        }
+        remove(dest.c_str());
+    }
+
+    // error
+    fprintf(stderr, "ERROR: could not move %s to %s\n", source.c_str(), dest.c_str());
+    perror("(above)");
+    return false;
+}
+
+bool Filesystem::copyFile(string source, string dest)
+{
+    FILE * in = fopen(source.c_str(), "rb");
+    if (! in)
+        return false;
+
+    FILE * out = fopen(dest.c_str(), "wb");
+    if (! out) {
+        fclose(in);
+        return false;
+    }
+
+    vector<char> buffer(0x100000);
+    bool success = true;
+    size_t count;
+    while ((count = fread(&buffer[0], 1, buffer.size(), in)) > 0) {
+        if (fwrite(&buffer[0], 1, count, out) != count) {
+            success = false;
+            break;
+        }
+    }
+    if (ferror(in))
+        success = false;
+
+    fclose(in);
+    if (fclose(out) != 0)
+        success = false;
+
+    return success;
 }
 
 void Filesystem::ensurePathExists(string path)
@@ -128,3 +195,14 @@ void Filesystem::ensurePathExists(string path)
 
     mkdir(path.c_str());
 }
+
+bool Filesystem::flushFile(string path)
+{
+    int fd = open(path.c_str(), O_WRONLY);
+    if (fd == -1)
+        return false;
+
+    bool success = _commit(fd) == 0;
+    close(fd);
+    return success;
+}
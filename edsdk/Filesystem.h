@@ -29,7 +29,23 @@ namespace Filesystem
     void ensurePathExists(string path);
 
     bool fileExists(string filename);
-    void moveFile(string source, string dest);
+
+    // atomically create an empty file as close to path as possible, see
+    // makeUnique(). unlike makeUnique, nobody else can grab the same name
+    // between us picking it and using it. returns the path of the new file,
+    // or an empty string if it couldn't be created.
+    string createUniqueFile(string path);
+
+    // rename source to dest, or copy it and delete source if they are on
+    // different volumes. never overwrites dest. with flush, a copy is on
+    // the disk before source goes, see flushFile(). returns success.
+    bool moveFile(string source, string dest, bool flush = false);
+    // streaming copy. returns success.
+    bool copyFile(string source, string dest);
+
+    // wait until what has been written to the file is on the disk, and
+    // not just in the OS's cache. returns success.
+    bool flushFile(string path);
 }
 
 #endif
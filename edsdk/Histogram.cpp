@@ -0,0 +1,69 @@
+#include "Histogram.h"
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+void Histogram::reset()
+{
+    for (int i = 0; i < c_bucketCount; i++)
+        m_buckets[i] = 0;
+    m_count = 0;
+    m_sum = 0;
+    m_min = 0;
+    m_max = 0;
+}
+
+void Histogram::add(long long value)
+{
+    if (value < 0)
+        value = 0;
+
+    int index = 0;
+    while (index < c_bucketCount - 1 && value >= bucketUpperBound(index))
+        ++index;
+    ++m_buckets[index];
+
+    if (m_count == 0 || value < m_min)
+        m_min = value;
+    if (m_count == 0 || value > m_max)
+        m_max = value;
+
+    ++m_count;
+    m_sum += value;
+}
+
+double Histogram::mean() const
+{
+    if (m_count == 0)
+        return 0.0;
+    return (double) m_sum / (double) m_count;
+}
+
+long long Histogram::percentile(double fraction) const
+{
+    if (m_count == 0)
+        return 0;
+
+    long long needed = (long long) (fraction * m_count + 0.5);
+    if (needed < 1)
+        needed = 1;
+
+    long long seen = 0;
+    for (int i = 0; i < c_bucketCount; i++) {
+        seen += m_buckets[i];
+        if (seen >= needed) {
+            // the bucket boundary can overshoot what we actually saw
+            long long bound = bucketUpperBound(i);
+            return bound < m_max ? bound : m_max;
+        }
+    }
+
+    return m_max;
+}
+
+long long Histogram::bucketUpperBound(int index)
+{
+    return 1LL << index;
+}
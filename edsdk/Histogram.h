@@ -0,0 +1,39 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+// keeps track of a distribution of durations (or any other non-negative
+// quantity) using power-of-two buckets, so adding a sample is cheap enough
+// to do on every frame.
+class Histogram
+{
+    public:
+        static const int c_bucketCount = 40;
+
+        Histogram();
+
+        void add(long long value);
+        void reset();
+
+        long long count() const { return m_count; }
+        long long minimum() const { return m_min; }
+        long long maximum() const { return m_max; }
+        double mean() const;
+
+        // returns an upper bound for the value below which fraction of
+        // the samples fall. fraction is in the range [0, 1].
+        long long percentile(double fraction) const;
+
+        // bucket i counts the samples in the range [2^(i-1), 2^i).
+        // bucket 0 counts the samples that are 0.
+        long long bucket(int index) const { return m_buckets[index]; }
+        static long long bucketUpperBound(int index);
+
+    private:
+        long long m_buckets[c_bucketCount];
+        long long m_count;
+        long long m_sum;
+        long long m_min;
+        long long m_max;
+};
+
+#endif
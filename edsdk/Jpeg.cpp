@@ -0,0 +1,251 @@
+#include "Jpeg.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <csetjmp>
+#include <algorithm>
+using namespace std;
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+namespace
+{
+    // libjpeg calls exit() on errors unless we give it somewhere else to go
+    struct ErrorManager {
+        jpeg_error_mgr pub;
+        jmp_buf jump;
+        char message[JMSG_LENGTH_MAX];
+    };
+
+    void errorExit(j_common_ptr info)
+    {
+        ErrorManager * manager = (ErrorManager *) info->err;
+        (*info->err->format_message)(info, manager->message);
+        longjmp(manager->jump, 1);
+    }
+
+    void outputMessage(j_common_ptr)
+    {
+        // warnings would go to stderr. we'd rather not hear about them.
+    }
+
+    // which source pixels make up each destination pixel along one axis,
+    // and how much each of them counts
+    struct Span {
+        int first;
+        int last;
+        // one per source pixel from first to last: how much of it is inside
+        // the destination pixel, over the width of the destination pixel.
+        // they add up to 1.
+        vector<float> weights;
+    };
+
+    void makeSpans(int source, int destination, vector<Span> & spans)
+    {
+        spans.resize(destination);
+        double ratio = (double) source / destination;
+        for (int i = 0; i < destination; i++) {
+            double start = i * ratio;
+            double end = (i + 1) * ratio;
+            Span & span = spans[i];
+            span.first = (int) start;
+            span.last = (int) ceil(end) - 1;
+            if (span.last >= source)
+                span.last = source - 1;
+            span.weights.assign(span.last - span.first + 1, (float) (1.0 / ratio));
+            if (span.first == span.last) {
+                span.weights[0] = (float) ((end - start) / ratio);
+            } else {
+                span.weights.front() = (float) ((span.first + 1 - start) / ratio);
+                span.weights.back() = (float) ((end - span.last) / ratio);
+            }
+        }
+    }
+}
+
+bool Jpeg::decode(const unsigned char * data, int size, Image & out, int scaleDenominator, string * error)
+{
+    jpeg_decompress_struct info;
+    ErrorManager manager;
+
+    info.err = jpeg_std_error(&manager.pub);
+    manager.pub.error_exit = &errorExit;
+    manager.pub.output_message = &outputMessage;
+
+    if (setjmp(manager.jump)) {
+        if (error)
+            *error = manager.message;
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, const_cast<unsigned char *>(data), size);
+    jpeg_read_header(&info, TRUE);
+
+    info.out_color_space = JCS_RGB;
+    info.scale_num = 1;
+    info.scale_denom = scaleDenominator;
+    // we care about speed more than the last bit of quality
+    info.dct_method = JDCT_IFAST;
+
+    jpeg_start_decompress(&info);
+
+    out.width = info.output_width;
+    out.height = info.output_height;
+    out.components = info.output_components;
+    int stride = out.width * out.components;
+    out.pixels.resize(stride * out.height);
+
+    while (info.output_scanline < info.output_height) {
+        JSAMPROW row = &out.pixels[info.output_scanline * stride];
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+
+    return true;
+}
+
+bool Jpeg::readSize(const unsigned char * data, int size, int & width, int & height, string * error)
+{
+    jpeg_decompress_struct info;
+    ErrorManager manager;
+
+    info.err = jpeg_std_error(&manager.pub);
+    manager.pub.error_exit = &errorExit;
+    manager.pub.output_message = &outputMessage;
+
+    if (setjmp(manager.jump)) {
+        if (error)
+            *error = manager.message;
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, const_cast<unsigned char *>(data), size);
+    jpeg_read_header(&info, TRUE);
+
+    width = info.image_width;
+    height = info.image_height;
+
+    jpeg_destroy_decompress(&info);
+    return true;
+}
+
+int Jpeg::scaleDenominatorFor(int width, int height, int minLongEdge)
+{
+    int longEdge = width > height ? width : height;
+    int denominator = 8;
+    // decode() rounds the scaled size up
+    while (denominator > 1 && (longEdge + denominator - 1) / denominator < minLongEdge)
+        denominator /= 2;
+    return denominator;
+}
+
+void Jpeg::resize(const Image & in, int maxLongEdge, Image & out)
+{
+    int longEdge = in.width > in.height ? in.width : in.height;
+    if (longEdge <= maxLongEdge) {
+        out = in;
+        return;
+    }
+
+    out.width = (int) ((double) in.width * maxLongEdge / longEdge + 0.5);
+    out.height = (int) ((double) in.height * maxLongEdge / longEdge + 0.5);
+    if (out.width < 1)
+        out.width = 1;
+    if (out.height < 1)
+        out.height = 1;
+    out.components = in.components;
+    out.pixels.resize(out.width * out.height * out.components);
+
+    vector<Span> columns, rows;
+    makeSpans(in.width, out.width, columns);
+    makeSpans(in.height, out.height, rows);
+
+    // a destination row at a time: add up its source rows across the full
+    // width, then the columns of that. the weights are looked up rather
+    // than worked out in the inner loops, which leaves them without
+    // branches, and the row loop runs along a whole row of floats, which
+    // the compiler vectorizes with -O3 (see setup.py).
+    int comps = in.components;
+    int inStride = in.width * comps;
+    vector<float> sum(inStride);
+    for (int y = 0; y < out.height; y++) {
+        const Span & rowSpan = rows[y];
+        fill(sum.begin(), sum.end(), 0.0f);
+        for (int sy = rowSpan.first; sy <= rowSpan.last; sy++) {
+            float weight = rowSpan.weights[sy - rowSpan.first];
+            const unsigned char * src = &in.pixels[sy * inStride];
+            float * acc = &sum[0];
+            for (int i = 0; i < inStride; i++)
+                acc[i] += src[i] * weight;
+        }
+
+        unsigned char * dst = &out.pixels[y * out.width * comps];
+        for (int x = 0; x < out.width; x++) {
+            const Span & columnSpan = columns[x];
+            const float * weights = &columnSpan.weights[0];
+            int count = columnSpan.weights.size();
+            for (int c = 0; c < comps; c++) {
+                const float * src = &sum[columnSpan.first * comps + c];
+                float total = 0;
+                for (int i = 0; i < count; i++)
+                    total += src[i * comps] * weights[i];
+                int value = (int) (total + 0.5f);
+                dst[x * comps + c] = (unsigned char) (value > 255 ? 255 : value);
+            }
+        }
+    }
+}
+
+bool Jpeg::encode(const Image & image, int quality, vector<unsigned char> & out, string * error)
+{
+    jpeg_compress_struct info;
+    ErrorManager manager;
+    // libjpeg mallocs the buffer as it goes
+    unsigned char * buffer = NULL;
+    unsigned long size = 0;
+
+    info.err = jpeg_std_error(&manager.pub);
+    manager.pub.error_exit = &errorExit;
+    manager.pub.output_message = &outputMessage;
+
+    if (setjmp(manager.jump)) {
+        if (error)
+            *error = manager.message;
+        jpeg_destroy_compress(&info);
+        free(buffer);
+        return false;
+    }
+
+    jpeg_create_compress(&info);
+    jpeg_mem_dest(&info, &buffer, &size);
+
+    info.image_width = image.width;
+    info.image_height = image.height;
+    info.input_components = image.components;
+    info.in_color_space = image.components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, quality, TRUE);
+    info.dct_method = JDCT_IFAST;
+
+    jpeg_start_compress(&info, TRUE);
+    int stride = image.width * image.components;
+    while (info.next_scanline < info.image_height) {
+        JSAMPROW row = const_cast<unsigned char *>(&image.pixels[info.next_scanline * stride]);
+        jpeg_write_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_compress(&info);
+    jpeg_destroy_compress(&info);
+
+    out.assign(buffer, buffer + size);
+    free(buffer);
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef JPEG_H
+#define JPEG_H
+
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace Jpeg
+{
+    // 8 bit per channel pixels, rows packed with no padding
+    struct Image {
+        int width;
+        int height;
+        int components;
+        vector<unsigned char> pixels;
+
+        Image() : width(0), height(0), components(0) {}
+    };
+
+    // decode jpeg data into RGB. libjpeg can scale by 1/2, 1/4 or 1/8 while
+    // it does the inverse DCT, which is a lot cheaper than decoding at full
+    // size and scaling afterwards, so pass scaleDenominator 2, 4 or 8 if you
+    // want a smaller image. returns success; on failure error says why.
+    bool decode(const unsigned char * data, int size, Image & out, int scaleDenominator = 1, string * error = NULL);
+
+    // reads only as far as the header, for the size of the image
+    bool readSize(const unsigned char * data, int size, int & width, int & height, string * error = NULL);
+
+    // the largest of 1, 2, 4 and 8 that decode() can scale width x height
+    // down by and still have the long edge at least minLongEdge
+    int scaleDenominatorFor(int width, int height, int minLongEdge);
+
+    // shrinks in to fit in maxLongEdge, averaging every source pixel that
+    // falls in a destination pixel. images that already fit are copied.
+    void resize(const Image & in, int maxLongEdge, Image & out);
+
+    // quality is 1 to 100
+    bool encode(const Image & image, int quality, vector<unsigned char> & out, string * error = NULL);
+}
+
+#endif
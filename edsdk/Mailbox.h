@@ -0,0 +1,212 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <windows.h>
+
+#include <cassert>
+#include <cstddef>
+
+// a single producer / multiple consumer mailbox which only ever holds the
+// newest value. consumers that are slower than the producer skip straight to
+// the latest value instead of working through a backlog, and each consumer
+// sees every value it gets exactly once.
+//
+// it is lock free. values live in slots which are written in place, so T can
+// be something big like a frame buffer. every consumer holds on to at most
+// one slot at a time, so with maxConsumers + 2 slots the producer always has
+// a slot to write to which is neither the latest one nor being read.
+template <class T>
+class Mailbox
+{
+    public:
+        class Consumer {
+            public:
+                // how many values were handed to this consumer
+                long received() const { return m_received; }
+                // how many values were published while this consumer was busy
+                // and it never saw
+                long dropped() const { return m_dropped; }
+
+            private:
+                Consumer() : m_lastGeneration(0), m_held(-1), m_received(0), m_dropped(0) {}
+
+                long m_lastGeneration;
+                int m_held;
+                long m_received;
+                long m_dropped;
+
+            friend class Mailbox;
+        };
+
+        explicit Mailbox(int maxConsumers) :
+            m_maxConsumers(maxConsumers),
+            m_slotCount(maxConsumers + 2),
+            m_consumerCount(0),
+            m_latest(0),
+            m_writing(-1)
+        {
+            assert(m_slotCount <= c_maxSlots);
+            m_slots = new T[m_slotCount];
+            m_readers = new LONG[m_slotCount];
+            m_consumers = new Consumer[m_maxConsumers];
+            for (int i = 0; i < m_slotCount; i++)
+                m_readers[i] = 0;
+        }
+
+        ~Mailbox()
+        {
+            delete[] m_slots;
+            delete[] m_readers;
+            delete[] m_consumers;
+        }
+
+        // slots are handed out for setup, for example to allocate buffers.
+        // don't use this once the producer is running.
+        int slotCount() const { return m_slotCount; }
+        T & slot(int index) { return m_slots[index]; }
+
+        // not thread safe. add all your consumers up front. returns NULL when
+        // there is no more room.
+        Consumer * addConsumer()
+        {
+            if (m_consumerCount >= m_maxConsumers)
+                return NULL;
+            return &m_consumers[m_consumerCount++];
+        }
+
+        // producer: get a slot to fill in. nobody else will look at it until
+        // you publish it. returns NULL if consumers are pinning every slot.
+        T * beginWrite()
+        {
+            int latest = slotOf(load());
+            for (int i = 0; i < m_slotCount; i++) {
+                if (i != latest && load(m_readers[i]) == 0) {
+                    m_writing = i;
+                    return &m_slots[i];
+                }
+            }
+            // can't happen as long as consumers follow the rules
+            return NULL;
+        }
+
+        // producer: make the slot from beginWrite the latest value
+        void publish()
+        {
+            assert(m_writing >= 0);
+            long generation = nextGeneration(generationOf(load()));
+            InterlockedExchange(&m_latest, pack(generation, m_writing));
+            m_writing = -1;
+        }
+
+        // producer: the latest generation that was published. 0 if none yet.
+        long generation() const
+        {
+            return generationOf(load());
+        }
+
+        // consumer: let go of the slot you were holding (if any) and get the
+        // newest one. isNew tells you if you have not seen it before.
+        // returns NULL if nothing has been published yet.
+        const T * acquire(Consumer * consumer, bool * isNew = NULL)
+        {
+            release(consumer);
+
+            while (true) {
+                LONG latest = load();
+                long generation = generationOf(latest);
+                if (generation == 0) {
+                    if (isNew)
+                        *isNew = false;
+                    return NULL;
+                }
+
+                int index = slotOf(latest);
+                InterlockedIncrement(&m_readers[index]);
+
+                // if it's still the latest then the producer can't be
+                // writing to it, and won't start now that we're reading it
+                if (load() != latest) {
+                    InterlockedDecrement(&m_readers[index]);
+                    continue;
+                }
+
+                consumer->m_held = index;
+                bool fresh = generation != consumer->m_lastGeneration;
+                if (fresh) {
+                    if (consumer->m_lastGeneration != 0)
+                        consumer->m_dropped += generationsBetween(consumer->m_lastGeneration, generation) - 1;
+                    consumer->m_lastGeneration = generation;
+                    ++consumer->m_received;
+                }
+                if (isNew)
+                    *isNew = fresh;
+                return &m_slots[index];
+            }
+        }
+
+        // consumer: done with the slot from acquire
+        void release(Consumer * consumer)
+        {
+            if (consumer->m_held < 0)
+                return;
+            InterlockedDecrement(&m_readers[consumer->m_held]);
+            consumer->m_held = -1;
+        }
+
+        // consumer: the slot you are holding, or NULL
+        const T * held(const Consumer * consumer) const
+        {
+            if (consumer->m_held < 0)
+                return NULL;
+            return &m_slots[consumer->m_held];
+        }
+
+    private:
+        // the latest slot and its generation are packed into one word so they
+        // can be swapped atomically
+        static const int c_slotBits = 8;
+        static const int c_maxSlots = 1 << c_slotBits;
+        static const long c_generationMask = 0x7fffff;
+
+        static LONG pack(long generation, int slot) { return (generation << c_slotBits) | slot; }
+        static long generationOf(LONG packed) { return (packed >> c_slotBits) & c_generationMask; }
+        static int slotOf(LONG packed) { return generationOf(packed) == 0 ? -1 : (int) (packed & (c_maxSlots - 1)); }
+
+        // generations wrap around, skipping 0 which means "nothing yet"
+        static long nextGeneration(long generation)
+        {
+            long next = (generation + 1) & c_generationMask;
+            return next == 0 ? 1 : next;
+        }
+
+        static long generationsBetween(long from, long to)
+        {
+            long count = (to - from) & c_generationMask;
+            return to < from ? count - 1 : count;
+        }
+
+        LONG load() const { return load(m_latest); }
+        static LONG load(const volatile LONG & value)
+        {
+            return InterlockedCompareExchange(const_cast<LONG *>(&value), 0, 0);
+        }
+
+        int m_maxConsumers;
+        int m_slotCount;
+        int m_consumerCount;
+
+        T * m_slots;
+        // how many consumers are holding (or about to hold) each slot
+        volatile LONG * m_readers;
+        Consumer * m_consumers;
+
+        volatile LONG m_latest;
+        // only touched by the producer
+        int m_writing;
+
+        // not copyable
+        Mailbox(const Mailbox &);
+        Mailbox & operator=(const Mailbox &);
+};
+
+#endif
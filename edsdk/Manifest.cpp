@@ -0,0 +1,147 @@
+#include "Manifest.h"
+
+#include <sstream>
+#include <cstring>
+
+#include <windows.h>
+#include <io.h>
+
+namespace {
+    const char * const c_header = "# edsdk card manifest: path, size, timestamp, taken, checksum\n";
+
+    bool truncateFile(FILE * file, long long length)
+    {
+        LARGE_INTEGER position;
+        position.QuadPart = length;
+        HANDLE handle = (HANDLE) _get_osfhandle(fileno(file));
+        return SetFilePointerEx(handle, position, NULL, FILE_BEGIN) && SetEndOfFile(handle);
+    }
+}
+
+Manifest::Manifest() :
+    m_log(NULL)
+{
+}
+
+Manifest::~Manifest()
+{
+    close();
+}
+
+bool Manifest::open(const string & path)
+{
+    close();
+    m_entries.clear();
+    m_path = path;
+
+    // up to the end of the last whole line
+    long long wholeLength = 0;
+    bool torn = false;
+    FILE * in = fopen(path.c_str(), "rb");
+    if (in) {
+        string line;
+        long long length = 0;
+        char buffer[0x10000];
+        size_t count;
+        while ((count = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+            length += count;
+            const char * start = buffer;
+            const char * end = buffer + count;
+            while (start < end) {
+                const char * newline = (const char *) memchr(start, '\n', end - start);
+                if (! newline) {
+                    line.append(start, end);
+                    break;
+                }
+                line.append(start, newline);
+                Entry entry;
+                if (parseLine(line, entry))
+                    m_entries[entry.path] = entry;
+                line.clear();
+                start = newline + 1;
+            }
+        }
+        // a line without a newline was cut off in the middle of being
+        // written, so it doesn't count
+        wholeLength = length - line.size();
+        torn = ! line.empty();
+        fclose(in);
+    }
+
+    m_log = fopen(path.c_str(), "ab");
+    if (! m_log) {
+        m_error = "Unable to open " + path + " for writing";
+        return false;
+    }
+
+    // cut the torn line off. finishing it with a newline would make it
+    // look whole the next time the log is read.
+    if (torn && ! truncateFile(m_log, wholeLength)) {
+        m_error = "Unable to cut the torn last line off " + path;
+        close();
+        return false;
+    }
+    if (wholeLength == 0)
+        fputs(c_header, m_log);
+    fflush(m_log);
+    return true;
+}
+
+void Manifest::close()
+{
+    if (m_log) {
+        fclose(m_log);
+        m_log = NULL;
+    }
+}
+
+const Manifest::Entry * Manifest::find(const string & path, long long size) const
+{
+    map<string, Entry>::const_iterator it = m_entries.find(path);
+    if (it == m_entries.end() || it->second.size != size)
+        return NULL;
+    return &it->second;
+}
+
+bool Manifest::add(const Entry & entry)
+{
+    if (! m_log)
+        return false;
+
+    m_entries[entry.path] = entry;
+
+    stringstream line;
+    line << entry.path << '\t' << entry.size << '\t' << entry.timestamp << '\t' << entry.taken << '\t'
+        << entry.checksum << '\n';
+    string text = line.str();
+
+    // a line at a time, so that a crash can only tear the last one
+    if (fwrite(text.data(), 1, text.size(), m_log) != text.size() || fflush(m_log) != 0) {
+        m_error = "Unable to write to " + m_path;
+        return false;
+    }
+    return true;
+}
+
+bool Manifest::parseLine(const string & line, Entry & entry)
+{
+    if (line.empty() || line[0] == '#')
+        return false;
+
+    size_t fields[4];
+    size_t start = 0;
+    for (int i = 0; i < 4; i++) {
+        fields[i] = line.find('\t', start);
+        if (fields[i] == string::npos)
+            return false;
+        start = fields[i] + 1;
+    }
+
+    entry.path = line.substr(0, fields[0]);
+    stringstream numbers(line.substr(fields[0] + 1, fields[2] - fields[0] - 1));
+    if (! (numbers >> entry.size >> entry.timestamp))
+        return false;
+    entry.taken = line.substr(fields[2] + 1, fields[3] - fields[2] - 1);
+    entry.checksum = line.substr(fields[3] + 1);
+    return ! entry.path.empty();
+}
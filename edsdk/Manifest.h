@@ -0,0 +1,67 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <string>
+#include <map>
+#include <cstdio>
+using namespace std;
+
+// what has been copied off a camera's cards, so that the next sync only
+// fetches what is new. kept as an append-only log of tab separated lines,
+// one per file, so a crash costs at most the line that was being written.
+// the last line for a path wins. a file is known by its path and size, and
+// by when it was taken, since the card can be formatted and the file
+// numbers start over.
+class Manifest
+{
+    public:
+        struct Entry {
+            // where it is on the card, like DCIM/100CANON/IMG_0042.JPG
+            string path;
+            long long size;
+            // when it was copied, in seconds since 1970
+            long long timestamp;
+            // when it was taken, from its EXIF, like "2026:10:18 14:03:22.42".
+            // empty for files without EXIF, like movies, which only go by
+            // path and size.
+            string taken;
+            // see Checksum::digest(). empty if checksums were off.
+            string checksum;
+        };
+
+        Manifest();
+        // closes the log
+        ~Manifest();
+
+        // reads the log at path, creating it if there isn't one, and keeps
+        // it open to append to. returns false if it can't be opened.
+        bool open(const string & path);
+        void close();
+        bool isOpen() const { return m_log != NULL; }
+        string path() const { return m_path; }
+
+        // what was copied from path if it was this size, or NULL. a file of
+        // another size at the same path is a different picture, from after
+        // the card was formatted or the file numbers started over. one of
+        // the same size can be too, see Entry::taken.
+        const Entry * find(const string & path, long long size) const;
+        // writes the entry to the log right away
+        bool add(const Entry & entry);
+        int size() const { return m_entries.size(); }
+
+        string error() const { return m_error; }
+
+    private:
+        string m_path;
+        FILE * m_log;
+        map<string, Entry> m_entries;
+        string m_error;
+
+        // returns false if the line isn't a whole entry
+        static bool parseLine(const string & line, Entry & entry);
+
+        Manifest(const Manifest &);
+        Manifest & operator=(const Manifest &);
+};
+
+#endif
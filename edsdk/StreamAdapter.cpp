@@ -0,0 +1,526 @@
+#include "StreamAdapter.h"
+
+#include <cstring>
+
+#include <io.h>
+
+namespace {
+    // sets the end of the file. extending it this way reserves the space
+    // without writing anything.
+    bool setFileLength(HANDLE file, long long length)
+    {
+        LARGE_INTEGER position;
+        position.QuadPart = length;
+        return SetFilePointerEx(file, position, NULL, FILE_BEGIN) && SetEndOfFile(file);
+    }
+
+    HANDLE fileHandle(FILE * file)
+    {
+        return (HANDLE) _get_osfhandle(fileno(file));
+    }
+}
+
+bool Sink::read(long long, void *, size_t, size_t & readSize)
+{
+    readSize = 0;
+    return false;
+}
+
+FileSink::FileSink(const string & path) :
+    m_path(path),
+    m_file(NULL),
+    m_position(0),
+    m_writing(false),
+    m_length(0),
+    m_allocated(0),
+    m_flush(false)
+{
+}
+
+FileSink::~FileSink()
+{
+    if (m_file)
+        fclose(m_file);
+}
+
+bool FileSink::open(long long expectedSize)
+{
+    m_file = fopen(m_path.c_str(), "w+b");
+    if (! m_file) {
+        m_error = "Unable to open " + m_path + " for writing";
+        return false;
+    }
+
+    m_buffer.resize(0x100000);
+    setvbuf(m_file, &m_buffer[0], _IOFBF, m_buffer.size());
+    m_position = 0;
+    m_writing = false;
+    m_length = 0;
+    m_allocated = 0;
+
+    // not being able to set the space aside isn't fatal, the file just
+    // grows the slow way
+    if (expectedSize > 0 && setFileLength(fileHandle(m_file), expectedSize))
+        m_allocated = expectedSize;
+    // the handle's file pointer moved behind stdio's back
+    m_position = -1;
+    return seek(0);
+}
+
+bool FileSink::seek(long long position)
+{
+    if (position == m_position)
+        return true;
+
+    if (_fseeki64(m_file, position, SEEK_SET) != 0) {
+        m_error = "Unable to seek in " + m_path;
+        return false;
+    }
+    m_position = position;
+    return true;
+}
+
+bool FileSink::write(long long position, const void * data, size_t size)
+{
+    if (! m_file || ! seek(position))
+        return false;
+
+    size_t count = fwrite(data, 1, size, m_file);
+    m_writing = true;
+    m_position += count;
+    if (m_position > m_length)
+        m_length = m_position;
+    if (count != size) {
+        m_error = "Unable to write to " + m_path;
+        return false;
+    }
+    return true;
+}
+
+bool FileSink::read(long long position, void * data, size_t size, size_t & readSize)
+{
+    readSize = 0;
+    if (! m_file)
+        return false;
+    // stdio wants a seek between a write and a read, even one to where
+    // the file already is
+    if (m_writing)
+        m_position = -1;
+    if (! seek(position))
+        return false;
+
+    m_writing = false;
+    readSize = fread(data, 1, size, m_file);
+    // the next write has to seek, which stdio wants between a read and a write
+    m_position = -1;
+    return ! ferror(m_file);
+}
+
+bool FileSink::finish()
+{
+    if (! m_file)
+        return false;
+
+    bool success = fflush(m_file) == 0;
+    // don't leave the unused part of the space we set aside on the end
+    if (success && m_allocated > m_length)
+        success = setFileLength(fileHandle(m_file), m_length);
+    if (success && m_flush)
+        success = FlushFileBuffers(fileHandle(m_file)) != 0;
+
+    if (fclose(m_file) != 0)
+        success = false;
+    m_file = NULL;
+    if (! success) {
+        m_error = "Unable to finish writing " + m_path;
+        return false;
+    }
+    return true;
+}
+
+void FileSink::abort()
+{
+    if (m_file) {
+        fclose(m_file);
+        m_file = NULL;
+    }
+    remove(m_path.c_str());
+}
+
+MappedFileSink::MappedFileSink(const string & path, long long size) :
+    m_path(path),
+    m_size(size),
+    m_length(0),
+    m_flush(false),
+    m_file(INVALID_HANDLE_VALUE),
+    m_mapping(NULL),
+    m_view(NULL)
+{
+}
+
+MappedFileSink::~MappedFileSink()
+{
+    close();
+}
+
+bool MappedFileSink::open()
+{
+    if (m_size <= 0) {
+        m_error = "Can't map an empty file";
+        return false;
+    }
+
+    m_file = CreateFileA(m_path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        m_error = "Unable to open " + m_path + " for writing";
+        return false;
+    }
+
+    // mapping a file at a size makes it that size, but do it ourselves
+    // first so a full disk shows up here and not as a fault in the middle
+    // of a write
+    if (! setFileLength(m_file, m_size)) {
+        m_error = "Unable to make room for " + m_path;
+        close();
+        return false;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READWRITE, (DWORD) (m_size >> 32), (DWORD) m_size, NULL);
+    if (m_mapping)
+        m_view = (unsigned char *) MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, (size_t) m_size);
+    if (! m_view) {
+        m_error = "Unable to map " + m_path + " into memory";
+        close();
+        return false;
+    }
+
+    m_length = 0;
+    return true;
+}
+
+void MappedFileSink::close()
+{
+    if (m_view) {
+        UnmapViewOfFile(m_view);
+        m_view = NULL;
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool MappedFileSink::write(long long position, const void * data, size_t size)
+{
+    if (! m_view)
+        return false;
+
+    if (position < 0 || position + (long long) size > m_size) {
+        m_error = "Write past the end of " + m_path;
+        return false;
+    }
+
+    memcpy(m_view + position, data, size);
+    if (position + (long long) size > m_length)
+        m_length = position + size;
+    return true;
+}
+
+bool MappedFileSink::read(long long position, void * data, size_t size, size_t & readSize)
+{
+    readSize = 0;
+    if (! m_view)
+        return false;
+    if (position >= m_length)
+        return true;
+
+    readSize = (size_t) (m_length - position);
+    if (readSize > size)
+        readSize = size;
+    memcpy(data, m_view + position, readSize);
+    return true;
+}
+
+bool MappedFileSink::finish()
+{
+    if (! m_view)
+        return false;
+
+    // the view's dirty pages go to the file, and FlushFileBuffers below
+    // takes them the rest of the way to the disk
+    bool success = true;
+    if (m_flush)
+        success = FlushViewOfFile(m_view, 0) != 0;
+
+    UnmapViewOfFile(m_view);
+    m_view = NULL;
+    CloseHandle(m_mapping);
+    m_mapping = NULL;
+
+    // the mapping has to be gone before the file can shrink
+    if (success && m_length < m_size)
+        success = setFileLength(m_file, m_length);
+    if (success && m_flush)
+        success = FlushFileBuffers(m_file) != 0;
+
+    if (! CloseHandle(m_file))
+        success = false;
+    m_file = INVALID_HANDLE_VALUE;
+    if (! success) {
+        m_error = "Unable to finish writing " + m_path;
+        return false;
+    }
+    return true;
+}
+
+void MappedFileSink::abort()
+{
+    close();
+    DeleteFileA(m_path.c_str());
+}
+
+MemorySink::MemorySink(vector<unsigned char> & data) :
+    m_vector(&data),
+    m_buffer(NULL),
+    m_capacity(0),
+    m_length(0)
+{
+}
+
+MemorySink::MemorySink(unsigned char * buffer, size_t capacity) :
+    m_vector(NULL),
+    m_buffer(buffer),
+    m_capacity(capacity),
+    m_length(0)
+{
+}
+
+bool MemorySink::write(long long position, const void * data, size_t size)
+{
+    size_t end = (size_t) position + size;
+    unsigned char * out;
+    if (m_vector) {
+        if (m_vector->size() < end)
+            m_vector->resize(end);
+        out = m_vector->empty() ? NULL : &(*m_vector)[0];
+    } else {
+        if (end > m_capacity) {
+            m_error = "The picture is bigger than the buffer it is going into";
+            return false;
+        }
+        out = m_buffer;
+    }
+
+    if (size > 0)
+        memcpy(out + position, data, size);
+    if (end > m_length)
+        m_length = end;
+    return true;
+}
+
+bool MemorySink::read(long long position, void * data, size_t size, size_t & readSize)
+{
+    readSize = 0;
+    if ((size_t) position >= m_length)
+        return true;
+
+    readSize = m_length - (size_t) position;
+    if (readSize > size)
+        readSize = size;
+    const unsigned char * in = m_vector ? &(*m_vector)[0] : m_buffer;
+    memcpy(data, in + position, readSize);
+    return true;
+}
+
+void TeeSink::add(Sink * sink, bool required)
+{
+    Branch branch;
+    branch.sink = sink;
+    branch.required = required;
+    branch.failed = false;
+    m_branches.push_back(branch);
+}
+
+bool TeeSink::fail(Branch & branch)
+{
+    branch.failed = true;
+    branch.error = branch.sink->error();
+    // get rid of what it has so far. the others don't need it.
+    branch.sink->abort();
+
+    if (branch.required) {
+        m_error = branch.error;
+        return false;
+    }
+    return true;
+}
+
+bool TeeSink::write(long long position, const void * data, size_t size)
+{
+    bool success = true;
+    for (unsigned int i = 0; i < m_branches.size(); i++) {
+        Branch & branch = m_branches[i];
+        if (branch.failed)
+            continue;
+        if (! branch.sink->write(position, data, size) && ! fail(branch))
+            success = false;
+    }
+    return success;
+}
+
+bool TeeSink::read(long long position, void * data, size_t size, size_t & readSize)
+{
+    // they all have the same bytes, so any one that can read will do
+    for (unsigned int i = 0; i < m_branches.size(); i++) {
+        if (! m_branches[i].failed && m_branches[i].sink->read(position, data, size, readSize))
+            return true;
+    }
+    readSize = 0;
+    return false;
+}
+
+bool TeeSink::finish()
+{
+    bool success = true;
+    for (unsigned int i = 0; i < m_branches.size(); i++) {
+        Branch & branch = m_branches[i];
+        if (branch.failed) {
+            if (branch.required)
+                success = false;
+            continue;
+        }
+        if (! branch.sink->finish() && ! fail(branch))
+            success = false;
+    }
+    return success;
+}
+
+void TeeSink::abort()
+{
+    for (unsigned int i = 0; i < m_branches.size(); i++) {
+        Branch & branch = m_branches[i];
+        if (! branch.failed) {
+            branch.failed = true;
+            branch.error = "Aborted";
+        }
+        branch.sink->abort();
+    }
+}
+
+StreamAdapter::StreamAdapter(Sink & sink, Checksum::Algorithm checksum) :
+    m_sink(sink),
+    m_stream(NULL),
+    m_position(0),
+    m_length(0),
+    m_checksum(checksum),
+    m_hashed(0),
+    m_inOrder(true)
+{
+    m_interface.context = this;
+    m_interface.read = &readCallback;
+    m_interface.write = &writeCallback;
+    m_interface.seek = &seekCallback;
+    m_interface.tell = &tellCallback;
+    m_interface.getLength = &getLengthCallback;
+}
+
+StreamAdapter::~StreamAdapter()
+{
+    close();
+}
+
+EdsError StreamAdapter::open()
+{
+    if (m_stream)
+        return EDS_ERR_OK;
+
+    EdsError err = EdsCreateStream(&m_interface, &m_stream);
+    if (err)
+        m_stream = NULL;
+    else if (! m_stream)
+        err = EDS_ERR_STREAM_NOT_OPEN;
+    return err;
+}
+
+EdsError StreamAdapter::close()
+{
+    if (! m_stream)
+        return EDS_ERR_OK;
+
+    EdsError err = EdsRelease(m_stream);
+    m_stream = NULL;
+    return err;
+}
+
+EdsError EDSSTDCALL StreamAdapter::readCallback(void * context, EdsUInt32 size, EdsVoid * buffer, EdsUInt32 * readSize)
+{
+    StreamAdapter * self = (StreamAdapter *) context;
+    size_t count = 0;
+    bool success = self->m_sink.read(self->m_position, buffer, size, count);
+    self->m_position += count;
+    if (readSize)
+        *readSize = count;
+    return success ? EDS_ERR_OK : EDS_ERR_FILE_READ_ERROR;
+}
+
+EdsError EDSSTDCALL StreamAdapter::writeCallback(void * context, EdsUInt32 size, const EdsVoid * buffer, EdsUInt32 * writtenSize)
+{
+    StreamAdapter * self = (StreamAdapter *) context;
+    if (writtenSize)
+        *writtenSize = 0;
+
+    if (! self->m_sink.write(self->m_position, buffer, size))
+        return EDS_ERR_FILE_WRITE_ERROR;
+
+    // the checksum only works if the bytes come in order
+    if (self->m_inOrder) {
+        if (self->m_position == self->m_hashed) {
+            self->m_checksum.update(buffer, size);
+            self->m_hashed += size;
+        } else {
+            self->m_inOrder = false;
+        }
+    }
+
+    self->m_position += size;
+    if (self->m_position > self->m_length)
+        self->m_length = self->m_position;
+    if (writtenSize)
+        *writtenSize = size;
+    return EDS_ERR_OK;
+}
+
+EdsError EDSSTDCALL StreamAdapter::seekCallback(void * context, EdsInt32 offset, EdsSeekOrigin origin)
+{
+    StreamAdapter * self = (StreamAdapter *) context;
+
+    long long position;
+    switch (origin) {
+        case kEdsSeek_Cur: position = self->m_position + offset; break;
+        case kEdsSeek_Begin: position = offset; break;
+        case kEdsSeek_End: position = self->m_length + offset; break;
+        default: return EDS_ERR_INVALID_PARAMETER;
+    }
+    if (position < 0)
+        return EDS_ERR_FILE_SEEK_ERROR;
+
+    self->m_position = position;
+    return EDS_ERR_OK;
+}
+
+EdsError EDSSTDCALL StreamAdapter::tellCallback(void * context, EdsInt32 * position)
+{
+    *position = (EdsInt32) ((StreamAdapter *) context)->m_position;
+    return EDS_ERR_OK;
+}
+
+EdsError EDSSTDCALL StreamAdapter::getLengthCallback(void * context, EdsUInt32 * length)
+{
+    *length = (EdsUInt32) ((StreamAdapter *) context)->m_length;
+    return EDS_ERR_OK;
+}
@@ -0,0 +1,230 @@
+#ifndef STREAM_ADAPTER_H
+#define STREAM_ADAPTER_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+using namespace std;
+
+#include <windows.h>
+
+#include "EDSDK.h"
+#include "EDSDKErrors.h"
+#include "EDSDKTypes.h"
+
+#include "Checksum.h"
+
+// somewhere the bytes of a download can go. the SDK almost always writes
+// from front to back, but it is allowed to seek, so writes say where they go.
+class Sink
+{
+    public:
+        virtual ~Sink() {}
+
+        // returns false if the bytes couldn't be taken. say why in error().
+        virtual bool write(long long position, const void * data, size_t size) = 0;
+        // for the rare SDK call that reads back what it wrote. sinks which
+        // can't do that leave it alone.
+        virtual bool read(long long position, void * data, size_t size, size_t & readSize);
+        // everything has been written. returns false if it couldn't be
+        // made to stick.
+        virtual bool finish() { return true; }
+        // the download failed, so get rid of whatever was written
+        virtual void abort() {}
+
+        string error() const { return m_error; }
+
+    protected:
+        string m_error;
+};
+
+// writes to a file, which it creates or truncates
+class FileSink : public Sink
+{
+    public:
+        explicit FileSink(const string & path);
+        ~FileSink();
+
+        // returns false if the file couldn't be opened. if you know how big
+        // the file is going to be, say so and the space is set aside in one
+        // go instead of growing the file a write at a time, which fragments
+        // the disk. finish() cuts it back if less than that was written.
+        bool open(long long expectedSize = 0);
+        // have finish() wait until the file is on the disk, not just in
+        // the OS's cache
+        void setFlush(bool flush) { m_flush = flush; }
+
+        bool write(long long position, const void * data, size_t size);
+        bool read(long long position, void * data, size_t size, size_t & readSize);
+        bool finish();
+        // closes and deletes the file
+        void abort();
+
+        string path() const { return m_path; }
+
+    private:
+        string m_path;
+        FILE * m_file;
+        long long m_position;
+        // the last thing done to the file was a write, so a read has to
+        // seek first
+        bool m_writing;
+        // the furthest anything was written, and how big the file was made
+        long long m_length;
+        long long m_allocated;
+        bool m_flush;
+        // handed to setvbuf, so that the SDK's small writes go out in big ones
+        vector<char> m_buffer;
+
+        bool seek(long long position);
+
+        FileSink(const FileSink &);
+        FileSink & operator=(const FileSink &);
+};
+
+// writes into a memory mapped view of a file whose size is known up front,
+// so the bytes go from the SDK into the page cache without a write call
+// in between. for big files, like movies and RAWs.
+class MappedFileSink : public Sink
+{
+    public:
+        MappedFileSink(const string & path, long long size);
+        ~MappedFileSink();
+
+        // creates the file at full size and maps it. returns false if that
+        // can't be done; use a FileSink instead.
+        bool open();
+        // see FileSink::setFlush()
+        void setFlush(bool flush) { m_flush = flush; }
+
+        // fails for writes past the size given to the constructor
+        bool write(long long position, const void * data, size_t size);
+        bool read(long long position, void * data, size_t size, size_t & readSize);
+        // unmaps and cuts the file back to what was written
+        bool finish();
+        // closes and deletes the file
+        void abort();
+
+    private:
+        string m_path;
+        long long m_size;
+        long long m_length;
+        bool m_flush;
+        HANDLE m_file;
+        HANDLE m_mapping;
+        unsigned char * m_view;
+
+        void close();
+
+        MappedFileSink(const MappedFileSink &);
+        MappedFileSink & operator=(const MappedFileSink &);
+};
+
+// writes into memory. either a vector, which grows as needed, or a buffer
+// of the caller's, which doesn't. the second is for when the size is known
+// up front and the bytes should land right where they are going to be used,
+// like a slot of an arena.
+class MemorySink : public Sink
+{
+    public:
+        explicit MemorySink(vector<unsigned char> & data);
+        MemorySink(unsigned char * buffer, size_t capacity);
+
+        bool write(long long position, const void * data, size_t size);
+        bool read(long long position, void * data, size_t size, size_t & readSize);
+
+        // how far the writes reached
+        size_t length() const { return m_length; }
+
+    private:
+        vector<unsigned char> * m_vector;
+        unsigned char * m_buffer;
+        size_t m_capacity;
+        size_t m_length;
+};
+
+// hands every write to several sinks, so one download can land in several
+// places. it doesn't own them.
+class TeeSink : public Sink
+{
+    public:
+        // the tee fails as soon as a required sink does. the others are
+        // aborted when they fail and the rest carry on without them.
+        void add(Sink * sink, bool required = true);
+
+        bool write(long long position, const void * data, size_t size);
+        bool read(long long position, void * data, size_t size, size_t & readSize);
+        // finishes the sinks that are still going
+        bool finish();
+        void abort();
+
+        // in the order they were added
+        int sinkCount() const { return m_branches.size(); }
+        // whether a sink failed or was aborted, and why
+        bool sinkFailed(int index) const { return m_branches[index].failed; }
+        string sinkError(int index) const { return m_branches[index].error; }
+
+    private:
+        struct Branch {
+            Sink * sink;
+            bool required;
+            bool failed;
+            string error;
+        };
+        vector<Branch> m_branches;
+
+        // returns false if the tee as a whole fails because of it
+        bool fail(Branch & branch);
+};
+
+// an EdsStreamRef that writes into a Sink, and optionally works out a
+// checksum on the way. the SDK never sees a buffer of ours, so a download
+// goes straight where it's wanted with no copies in between.
+class StreamAdapter
+{
+    public:
+        explicit StreamAdapter(Sink & sink, Checksum::Algorithm checksum = Checksum::None);
+        // releases the stream
+        ~StreamAdapter();
+
+        EdsError open();
+        // NULL until open() succeeds
+        EdsStreamRef stream() const { return m_stream; }
+        EdsError close();
+
+        // the furthest anything was written
+        long long length() const { return m_length; }
+
+        // false if the SDK wrote out of order, in which case the checksum
+        // doesn't cover the data and you have to do it yourself
+        bool checksumValid() const { return m_inOrder; }
+        string digest() const { return m_checksum.digest(); }
+
+        // what went wrong in the sink, if anything
+        string error() const { return m_sink.error(); }
+
+    private:
+        Sink & m_sink;
+        EdsIStream m_interface;
+        EdsStreamRef m_stream;
+
+        long long m_position;
+        long long m_length;
+
+        Checksum m_checksum;
+        // bytes fed to m_checksum so far
+        long long m_hashed;
+        bool m_inOrder;
+
+        static EdsError EDSSTDCALL readCallback(void * context, EdsUInt32 size, EdsVoid * buffer, EdsUInt32 * readSize);
+        static EdsError EDSSTDCALL writeCallback(void * context, EdsUInt32 size, const EdsVoid * buffer, EdsUInt32 * writtenSize);
+        static EdsError EDSSTDCALL seekCallback(void * context, EdsInt32 offset, EdsSeekOrigin origin);
+        static EdsError EDSSTDCALL tellCallback(void * context, EdsInt32 * position);
+        static EdsError EDSSTDCALL getLengthCallback(void * context, EdsUInt32 * length);
+
+        StreamAdapter(const StreamAdapter &);
+        StreamAdapter & operator=(const StreamAdapter &);
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include "Threading.h"
+
+#include <process.h>
+
+Thread::Thread() :
+    m_handle(NULL),
+    m_function(NULL),
+    m_context(NULL)
+{
+}
+
+Thread::~Thread()
+{
+    join();
+}
+
+bool Thread::start(Function function, void * context)
+{
+    if (m_handle)
+        return false;
+
+    m_function = function;
+    m_context = context;
+
+    // _beginthreadex rather than CreateThread so the C runtime gets set up
+    // for the new thread
+    m_handle = (HANDLE) _beginthreadex(NULL, 0, &Thread::run, this, 0, NULL);
+    return m_handle != NULL;
+}
+
+bool Thread::setPriority(int priority)
+{
+    return m_handle && SetThreadPriority(m_handle, priority);
+}
+
+void Thread::join()
+{
+    if (! m_handle)
+        return;
+
+    WaitForSingleObject(m_handle, INFINITE);
+    CloseHandle(m_handle);
+    m_handle = NULL;
+}
+
+unsigned __stdcall Thread::run(void * self)
+{
+    Thread * thread = (Thread *) self;
+    thread->m_function(thread->m_context);
+    return 0;
+}
@@ -0,0 +1,90 @@
+#ifndef THREADING_H
+#define THREADING_H
+
+#include <windows.h>
+
+#include <climits>
+
+// thin wrappers around the win32 primitives we use to get work off of the
+// thread that runs the SDK.
+
+class Mutex
+{
+    public:
+        Mutex() { InitializeCriticalSection(&m_section); }
+        ~Mutex() { DeleteCriticalSection(&m_section); }
+
+        void lock() { EnterCriticalSection(&m_section); }
+        void unlock() { LeaveCriticalSection(&m_section); }
+
+    private:
+        CRITICAL_SECTION m_section;
+
+        // not copyable
+        Mutex(const Mutex &);
+        Mutex & operator=(const Mutex &);
+};
+
+// holds a mutex for as long as it is in scope
+class Lock
+{
+    public:
+        explicit Lock(Mutex & mutex) : m_mutex(mutex) { m_mutex.lock(); }
+        ~Lock() { m_mutex.unlock(); }
+
+    private:
+        Mutex & m_mutex;
+
+        // not copyable
+        Lock(const Lock &);
+        Lock & operator=(const Lock &);
+};
+
+class Semaphore
+{
+    public:
+        Semaphore() { m_handle = CreateSemaphore(NULL, 0, LONG_MAX, NULL); }
+        ~Semaphore() { CloseHandle(m_handle); }
+
+        void post(int count = 1) { ReleaseSemaphore(m_handle, count, NULL); }
+        void wait() { WaitForSingleObject(m_handle, INFINITE); }
+        // returns false if it timed out
+        bool wait(int milliseconds) { return WaitForSingleObject(m_handle, milliseconds) == WAIT_OBJECT_0; }
+
+    private:
+        HANDLE m_handle;
+
+        // not copyable
+        Semaphore(const Semaphore &);
+        Semaphore & operator=(const Semaphore &);
+};
+
+class Thread
+{
+    public:
+        typedef void (* Function)(void * context);
+
+        Thread();
+        // waits for the thread to finish
+        ~Thread();
+
+        bool start(Function function, void * context);
+        // one of the THREAD_PRIORITY_ values. returns success.
+        bool setPriority(int priority);
+        // wait for the thread to finish
+        void join();
+        bool started() const { return m_handle != NULL; }
+
+    private:
+        static unsigned __stdcall run(void * self);
+
+        HANDLE m_handle;
+        Function m_function;
+        void * m_context;
+
+        // not copyable
+        Thread(const Thread &);
+        Thread & operator=(const Thread &);
+};
+
+#endif
@@ -1,6 +1,8 @@
 #include "Utils.h"
 #include <sstream>
 
+#include <windows.h>
+
 int Utils::stringToInt(std::string value)
 {
     std::stringstream ss;
@@ -17,4 +19,17 @@ std::string Utils::intToString(int value)
     return ss.str();
 }
 
+long long Utils::monotonicMicros()
+{
+    static LARGE_INTEGER frequency = {{0, 0}};
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
 
+    // split the division so we don't overflow the multiplication
+    long long seconds = now.QuadPart / frequency.QuadPart;
+    long long remainder = now.QuadPart % frequency.QuadPart;
+    return seconds * 1000000LL + remainder * 1000000LL / frequency.QuadPart;
+}
@@ -12,6 +12,10 @@ namespace Utils
     int stringToInt(string value);
     string intToString(int value);
 
+    // microseconds since an arbitrary point in the past. never goes
+    // backwards, so it is suitable for measuring latency.
+    long long monotonicMicros();
+
     // returns the closest value for key 
     template<class K, class V>
     V closest(map<K, V> & _map, const K & key) {
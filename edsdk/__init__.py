@@ -11,6 +11,8 @@ _running = False
 _comThread = None
 _callbacksThread = None
 _callbackQueue = queue.Queue()
+# cameras which need poll() called on them. only touched from the com thread.
+_connectedCameras = []
 
 def _make_thread(target, name, args=[]):
     return threading.Thread(target=target, name=name, args=args)
@@ -29,13 +31,24 @@ def _run_com_thread():
         except queue.Empty:
             pass
         pythoncom.PumpWaitingMessages()
-        time.sleep(0.05)
+        # sleep less if a camera has a timelapse shot or a bulb exposure
+        # coming up
+        delay = 50
+        for cam in _connectedCameras:
+            cam._camera.poll()
+            delay = cam._camera.pollDelay(delay)
+        _flushErrors()
+        time.sleep(delay / 1000.0)
 
 def _run_callbacks_thread():
     while _running:
         func, args = _callbackQueue.get(block=True)
         func(args)
 
+def _queueCallback(callback, *args):
+    # the callbacks thread passes one argument, so spread them out here
+    _callbackQueue.put((lambda a: callback(*a), args))
+
 def _runInComThread(func, args=None, callback=None):
     if args is None:
         args = []
@@ -78,6 +91,10 @@ class DriveMode:
     TenSecSelfTimer = 0x00000010
     TwoSecSelfTimer = 0x00000011
 
+class CaptureLiveViewMode:
+    RestartLiveView = 0
+    KeepLiveView = 1
+
 class AFMode:
     OneShotAF = 0
     AIServoAF = 1
@@ -138,16 +155,62 @@ class Camera:
     """
     def _checkPictureQueue(self):
         while self._running:
+            while True:
+                preview = self._camera.popPicturePreview()
+                if preview is None:
+                    break
+                if self._picturePreviewCallback:
+                    _queueCallback(self._picturePreviewCallback, preview['cameraFilename'], preview['data'])
+            while True:
+                progress = self._camera.popTransferProgress()
+                if progress is None:
+                    break
+                if self._transferProgressCallback:
+                    _callbackQueue.put((self._transferProgressCallback, progress))
+            while True:
+                derivative = self._camera.popDerivative()
+                if derivative is None:
+                    break
+                if self._derivativeCallback:
+                    _callbackQueue.put((self._derivativeCallback, derivative))
+            while True:
+                ingested = self._camera.popIngestedFile()
+                if ingested is None:
+                    break
+                if self._ingestCallback:
+                    _callbackQueue.put((self._ingestCallback, ingested))
             while self._camera.pictureDoneQueueSize() > 0:
-                pic = self._camera.popPictureDoneQueue()
+                pic = self._camera.popCompletedPicture()
                 _flushErrors()
-                if self._pictureCompleteCallback:
-                    _callbackQueue.put((self._pictureCompleteCallback, pic))
+                if self._pictureDoneCallback:
+                    _callbackQueue.put((self._pictureDoneCallback, pic))
+                if pic['filename'] is None:
+                    if self._pictureDataCallback:
+                        if self._pictureDataAllFiles:
+                            files = [(pic['cameraFilename'], pic['data'])]
+                            files.extend((c['cameraFilename'], c['data']) for c in pic['companions'])
+                            _callbackQueue.put((self._pictureDataCallback, files))
+                        else:
+                            _queueCallback(self._pictureDataCallback, pic['cameraFilename'], pic['data'])
+                elif self._pictureCompleteCallback:
+                    if self._pictureCompleteAllFiles:
+                        files = [pic['filename']] + [c['filename'] for c in pic['companions']]
+                        _callbackQueue.put((self._pictureCompleteCallback, files))
+                    else:
+                        _callbackQueue.put((self._pictureCompleteCallback, pic['filename']))
             time.sleep(0.10)
 
     def __init__(self, cpp_camera):
         self._camera = cpp_camera
         self._pictureCompleteCallback = None
+        self._pictureCompleteAllFiles = False
+        self._derivativeCallback = None
+        self._pictureDataCallback = None
+        self._pictureDataAllFiles = False
+        self._transferProgressCallback = None
+        self._picturePreviewCallback = None
+        self._pictureDoneCallback = None
+        self._ingestCallback = None
         self._liveViewOn = False
         self._running = False
 
@@ -162,7 +225,10 @@ class Camera:
         self._pictureThread = _make_thread(Camera._checkPictureQueue, "edsdk._checkPictureQueue", args=(self,))
         self._pictureThread.start()
 
-        _runInComThread(self._camera.connect)
+        def f():
+            if self._camera.connect():
+                _connectedCameras.append(self)
+        _runInComThread(f)
 
     def disconnect(self):
         if not self._running:
@@ -170,7 +236,11 @@ class Camera:
 
         self._running = False
 
-        _runInComThread(self._camera.disconnect)
+        def f():
+            if self in _connectedCameras:
+                _connectedCameras.remove(self)
+            self._camera.disconnect()
+        _runInComThread(f)
         self._pictureThread.join()
 
     def name(self, callback):
@@ -180,13 +250,297 @@ class Camera:
         _runInComThread(self._camera.name, callback=callback)
 
     def takePicture(self, filename):
+        """
+        you can take the next picture before this one is done; each one goes
+        to its own filename. if the camera sends more than one frame for the
+        shot, like in continuous drive mode, %n in filename is replaced with
+        the frame number, starting at 1.
+        """
         _runInComThread(self._camera.takeSinglePicture, args=[filename])
 
-    def setPictureCompleteCallback(self, callback):
+    def takeBurst(self, count, nameTemplate, driveMode=DriveMode.HighSpeedContinuousShooting):
+        """
+        holds the shutter button down in driveMode until count pictures are
+        taken, downloading them as they come. they are saved to nameTemplate
+        with %n replaced by the frame number. the picture complete callback
+        is called for every frame.
+        """
+        _runInComThread(self._camera.takeBurst, args=[count, nameTemplate, driveMode])
+
+    def startTimelapse(self, interval, count, nameTemplate, skipWhenBusy=True):
+        """
+        takes a picture every interval seconds, count times, or until
+        stopTimelapse if count is 0. shots are timed against a fixed
+        schedule so that lateness doesn't add up. pictures are saved to
+        nameTemplate with %n replaced by the shot number. if a shot comes
+        due while the last picture is still being taken or downloaded, it
+        is skipped, or taken anyway and marked as overlapped if skipWhenBusy
+        is False.
+        """
+        _runInComThread(self._camera.startTimelapse, args=[int(round(interval * 1000)), count, nameTemplate, skipWhenBusy])
+
+    def stopTimelapse(self):
+        _runInComThread(self._camera.stopTimelapse)
+
+    def timelapseReport(self):
+        """
+        returns a dict of shot counts, a jitter histogram, and a list of
+        the last hundred shots with their deadline, when they went out, and
+        their status. times are monotonic microseconds.
+        """
+        return self._camera.timelapseReport()
+
+    def takeBulbExposure(self, duration, outFile):
+        """
+        holds the shutter open for duration seconds with the camera in bulb
+        mode, and saves the picture to outFile. the shutter is closed from
+        the camera thread against the performance counter, not a python
+        sleep. if bulb exposures are already going, this one is queued
+        after them.
+        """
+        _runInComThread(self._camera.takeBulbExposure, args=[int(round(duration * 1000)), outFile])
+
+    def takeBulbSequence(self, count, duration, gap, nameTemplate):
+        """
+        queues count bulb exposures of duration seconds, gap seconds from
+        the close of one to the open of the next, for stacking. pictures
+        are saved to nameTemplate with %n replaced by the exposure number.
+        a camera still busy with the last picture (long exposure noise
+        reduction, say) is waited for.
+        """
+        _runInComThread(self._camera.takeBulbSequence, args=[count, int(round(duration * 1000)), int(round(gap * 1000)), nameTemplate])
+
+    def cancelBulb(self):
+        _runInComThread(self._camera.cancelBulb)
+
+    def bulbReport(self):
+        """
+        returns a dict of exposure counts, a histogram of how far off the
+        exposures were either way (absoluteError), and a list of the last
+        hundred exposures with when the open and close commands went out
+        and came back, the achieved duration (between the middles of the
+        two), its signed error against the requested one, and how far it
+        can be off (uncertainty). times are monotonic microseconds.
+        """
+        return self._camera.bulbReport()
+
+    def startIngest(self, folder, maxInFlight=4, callback=None):
+        """
+        copies every picture on the camera's cards into folder, oldest
+        first, under the camera's names. the cards are listed while the
+        pictures download, and at most maxInFlight are downloading or
+        waiting to at once. callback(file), if given, gets a dict like the
+        picture done dict for every file copied.
+        """
+        self._ingestCallback = callback
+        _runInComThread(self._camera.startIngest, args=[folder, maxInFlight])
+
+    def startSync(self, folder, maxInFlight=4, fullScan=False, callback=None):
+        """
+        like startIngest, but keeps a manifest of what has been copied from
+        this camera in folder, and only copies what isn't in it yet. each
+        card folder is listed from its newest file back to the first one
+        the manifest has; fullScan=True looks at every file instead, which
+        finds gaps but takes as long as listing the whole card. files are
+        known by their path, size, and when they were taken, so a card that
+        was formatted since doesn't look synced. after that, pictures the
+        camera saves only to its card are copied as they appear, until the
+        camera disconnects.
+        """
+        self._ingestCallback = callback
+        _runInComThread(self._camera.startSync, args=[folder, maxInFlight, fullScan])
+
+    def stopIngest(self):
+        _runInComThread(self._camera.stopIngest)
+
+    def ingestReport(self):
+        """
+        returns a dict with how many files were found and copied or failed,
+        how many a sync left alone because it had them (alreadyCopied),
+        how many bytes, start and end times (monotonic microseconds, end is
+        0 while it runs), and megabytesPerSecond copied so far.
+        """
+        return self._camera.ingestReport()
+
+    def lastBurst(self):
+        """
+        returns a dict with the requested frame count, when the shutter was
+        pressed and released, capture and sustained frames per second, and
+        a list of frames with their capture and transfer times (monotonic
+        microseconds) and filenames.
+        """
+        return self._camera.lastBurst()
+
+    def takePictureToMemory(self):
+        """
+        takes a picture without writing it to disk. the picture data
+        callback gets it.
+        """
+        _runInComThread(self._camera.takeSinglePictureToMemory)
+
+    def prefocus(self):
+        """
+        holds the shutter button halfway, so the camera focuses and meters
+        now and takePrefocusedPicture() goes off without waiting for it.
+        """
+        _runInComThread(self._camera.prefocus)
+
+    def takePrefocusedPicture(self, filename, keepHolding=False):
+        """
+        like takePicture(), but uses the focus from prefocus(). with
+        keepHolding the shutter button goes back to halfway afterwards, so
+        the next one is just as quick; otherwise it is let go.
+        """
+        _runInComThread(self._camera.takePrefocusedPicture, args=[filename, int(keepHolding)])
+
+    def releaseFocus(self):
+        _runInComThread(self._camera.releaseFocus)
+
+    def shutterLagStats(self):
+        """
+        returns a dict of histograms (in microseconds). takePictureCommand
+        and prefocusedCommand are how long the command that fires took to
+        come back with takePicture() and takePrefocusedPicture();
+        takePictureToRequest and prefocusedToRequest run from that command
+        going out to the camera offering the picture. compare the two pairs
+        to see what prefocusing saves. prefocusCommand is the half press.
+        """
+        return self._camera.shutterLagStats()
+
+    def resetShutterLagStats(self):
+        self._camera.resetShutterLagStats()
+
+    def captureLiveViewMode(self, callback):
+        """
+        callback(mode) will be called with a CaptureLiveViewMode value
+        """
+        _runInComThread(self._camera.captureLiveViewMode, callback=callback)
+
+    def setCaptureLiveViewMode(self, mode):
+        """
+        CaptureLiveViewMode.KeepLiveView leaves live view running while a
+        picture is taken on bodies that support it, instead of stopping it
+        and starting it again after the transfer.
+        """
+        _runInComThread(self._camera.setCaptureLiveViewMode, args=[mode])
+
+    def setPictureCompleteCallback(self, callback, allFiles=False):
         """
         callback(filename) will be called after every picture is successfully downloaded to disk.
+        with allFiles, callback(filenames) gets every file of the picture
+        instead, like the JPEG and the RAW when shooting RAW+JPEG.
         """
         self._pictureCompleteCallback = callback
+        self._pictureCompleteAllFiles = allFiles
+
+    def setPictureDataCallback(self, callback, allFiles=False):
+        """
+        callback(cameraFilename, data) will be called with the bytes of every
+        picture taken with takePictureToMemory. with allFiles,
+        callback(files) gets a list of (cameraFilename, data) instead, one
+        for every file of the picture.
+        """
+        self._pictureDataCallback = callback
+        self._pictureDataAllFiles = allFiles
+
+    def setPictureDoneCallback(self, callback):
+        """
+        callback(picture) will be called for every picture, on disk or in
+        memory, with a dict of everything known about it: filename (None
+        if it is in memory), cameraFilename, data (None if it is on disk),
+        checksum (see setChecksum), durability (see setDurability), copies
+        (see setBackupFolders), metadata, and companions, a list of dicts
+        like it for the other files of the picture, like the RAW of
+        RAW+JPEG. metadata is read from the picture's EXIF as it comes in:
+        make, model, serialNumber, lensModel, dateTimeOriginal,
+        subSecTimeOriginal, exposureFraction (numerator, denominator),
+        exposureTime in seconds, fNumber, iso, exposureBias in stops,
+        focalLength in mm, orientation, flash, width and height. it is None
+        for files without EXIF, like movies.
+        """
+        self._pictureDoneCallback = callback
+
+    def setChecksum(self, algorithm):
+        """
+        work out a checksum of every picture while it downloads, so you
+        don't have to read it back. algorithm is 'none', 'crc32c' or
+        'sha256'. the checksum is in the picture done dict as
+        'algorithm:hex digest'.
+        """
+        _runInComThread(self._camera.setChecksum, args=[algorithm])
+
+    def setDurability(self, durability, groupCommitInterval=0.02):
+        """
+        how sure to be that a picture is on the disk before it is handed
+        out. 'none' leaves it to the OS, 'file' flushes every file as it
+        downloads, and 'group' flushes the files that finish within
+        groupCommitInterval seconds of each other together, which costs
+        less when pictures come quickly. the picture done dict says what
+        each picture got as 'durability'.
+        """
+        _runInComThread(self._camera.setDurability, args=[durability, int(groupCommitInterval * 1000)])
+
+    def setBackupFolders(self, folders):
+        """
+        write every picture that goes to disk into each of these folders
+        as well, under the same name, while it downloads instead of copying
+        it afterwards. a backup failing doesn't fail the picture. the picture
+        done dict lists them as 'copies', dicts with filename, success and
+        error.
+        """
+        _runInComThread(self._camera.setBackupFolders, args=[list(folders)])
+
+    def setKeepPictureData(self, keep):
+        """
+        hand out the bytes of pictures that go to disk as well, as 'data'
+        in the picture done dict, without reading the file back.
+        """
+        _runInComThread(self._camera.setKeepPictureData, args=[bool(keep)])
+
+    def setDerivatives(self, derivatives, callback=None):
+        """
+        write resized copies of every JPEG that goes to disk, for example
+        [('web', 2048, 85), ('thumb', 256, 80)]: a list of (name, maxSize,
+        quality). each goes into a folder called name next to the picture,
+        with its long edge at most maxSize pixels. pictures are decoded
+        once, on threads that give way to live view decoding.
+        callback(derivative), if given, gets a dict for each one as soon as
+        it is written: source, name, filename, width, height, success,
+        error (None if it worked) and latency, microseconds from the
+        picture being saved. pass an empty list to stop.
+        """
+        self._derivativeCallback = callback
+        _runInComThread(self._camera.setDerivatives, args=[[tuple(d) for d in derivatives]])
+
+    def setPicturePreviewCallback(self, callback):
+        """
+        callback(cameraFilename, data) will be called with the jpeg thumbnail
+        of every picture as soon as it is off the camera, before the picture
+        itself is. pass None to stop downloading thumbnails.
+        """
+        self._picturePreviewCallback = callback
+        _runInComThread(self._camera.setPicturePreviews, args=[callback is not None])
+
+    def setTransferProgressCallback(self, callback):
+        """
+        callback(progress) will be called while pictures download, where
+        progress is a dict with the transfer number, cameraFilename,
+        percent, size and bytesDone in bytes, and elapsed in microseconds.
+        """
+        self._transferProgressCallback = callback
+
+    def transferStats(self):
+        """
+        returns a dict with how many pictures were downloaded and failed,
+        how many bytes came off the camera, and histograms of download time
+        and time from the camera's transfer request to completion (in
+        microseconds) and of throughput (in KB/s). groupCommitDelay is how
+        long files waited to be flushed with setDurability('group').
+        """
+        return self._camera.transferStats()
+
+    def resetTransferStats(self):
+        self._camera.resetTransferStats()
 
     def startLiveView(self):
         def cb(success):
@@ -200,6 +554,13 @@ class Camera:
         _runInComThread(self._camera.stopLiveView, callback=cb)
         self._liveViewOn = False
 
+    def liveViewState(self, callback):
+        """
+        callback(state) will be called with the name of the live view state,
+        for example "On" or "WaitingToStart"
+        """
+        _runInComThread(self._camera.liveViewState, callback=callback)
+
     def grabLiveViewFrame(self):
         """
         tell the camera to refresh its frame buffer with a new live view
@@ -212,10 +573,60 @@ class Camera:
     def liveViewMemoryView(self):
         """
         use this method to get a memoryview object which you can use to
-        directly access frame image data.
+        directly access frame image data. the view always shows the newest
+        frame at the time it was made, and that frame won't be overwritten
+        while the view is alive. get a new view for every frame.
         """
         return memoryview(self._camera)
 
+    def liveViewFrameInfo(self):
+        """
+        returns (sequence, request, download, acquire) for the frame currently
+        in the frame buffer. times are monotonic microseconds; acquire is 0
+        until something has looked at the frame.
+        """
+        return self._camera.liveViewFrameInfo()
+
+    def liveViewStats(self):
+        """
+        returns a dict with counters of grabbed and skipped frames, latency
+        histograms (in microseconds) for the live view stream, start/stop
+        latency histograms, transition timeouts, time spent in each state
+        and how many frames each frame consumer received and dropped.
+        """
+        return self._camera.liveViewStats()
+
+    def resetLiveViewStats(self):
+        self._camera.resetLiveViewStats()
+
+    def enableLiveViewDecode(self, scaleDenominator=1):
+        """
+        decode every grabbed live view frame to RGB on a thread pool which
+        is shared by all cameras. scaleDenominator 2, 4 or 8 gives a smaller
+        image for a lot less work. get the result with decodedLiveViewFrame.
+        """
+        _runInComThread(self._camera.enableLiveViewDecode, args=[scaleDenominator])
+
+    def disableLiveViewDecode(self):
+        _runInComThread(self._camera.disableLiveViewDecode)
+
+    def decodedLiveViewFrame(self):
+        """
+        returns (sequence, width, height, pixels) of the newest decoded live
+        view frame, where pixels is bytes of packed 8 bit RGB rows, or None
+        if no frame has been decoded yet.
+        """
+        return self._camera.decodedLiveViewFrame()
+
+    def liveViewDecodeStats(self):
+        """
+        returns a dict with how many of this camera's frames the decode pool
+        was given, decoded, failed on and dropped, its current and maximum
+        queue depth, and histograms (in microseconds) of how long frames
+        waited in the queue and took to decode. None if decoding is off.
+        """
+        return self._camera.liveViewDecodeStats()
+
     def liveViewImageSize(self):
         return self._camera.liveViewImageSize()
 
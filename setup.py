@@ -8,6 +8,14 @@ camera = Extension(
         'edsdk/ErrorMap.cpp',
         'edsdk/Utils.cpp',
         'edsdk/Filesystem.cpp',
+        'edsdk/Histogram.cpp',
+        'edsdk/Threading.cpp',
+        'edsdk/Jpeg.cpp',
+        'edsdk/DecodePool.cpp',
+        'edsdk/Checksum.cpp',
+        'edsdk/StreamAdapter.cpp',
+        'edsdk/Manifest.cpp',
+        'edsdk/Exif.cpp',
         'edsdk/CameraModule.cpp',
     ],
     include_dirs = [
@@ -16,10 +24,16 @@ camera = Extension(
     libraries = [
         'ole32',
         'EDSDK',
+        'jpeg',
     ],
     define_macros = [
         ('NDEBUG', 1),
     ],
+    # the derivative resampler in Jpeg.cpp counts on the vectorizer
+    extra_compile_args = [
+        '-O3',
+        '-ftree-vectorize',
+    ],
 )
 
 setup(
@@ -20,10 +20,15 @@ int main() {
         cout << "Taking a picture to c:\\testpics\\hi.jpg" << endl;
         cam->takeSinglePicture("C:\\testpics\\hi.jpg");
 
+        // pictures are downloaded on another thread and handed out by poll()
         MSG msg;
-        while (GetMessage(&msg, NULL, 0, 0) > 0) {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
+        while (true) {
+            while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+                TranslateMessage(&msg);
+                DispatchMessage(&msg);
+            }
+            cam->poll();
+            Sleep(cam->pollDelay(50));
         }
     }
 